@@ -0,0 +1,659 @@
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "re2dfa.hpp"
+
+using benchClock = std::chrono::steady_clock;
+
+double millisecondsSince(benchClock::time_point start) {
+  return std::chrono::duration<double, std::milli>(benchClock::now() - start)
+      .count();
+}
+
+std::string repeatString(const std::string &s, size_t n) {
+  std::string res{};
+  for (size_t i = 0; i < n; ++i) {
+    res += s;
+  }
+  return res;
+}
+
+const std::string SYMBOLS = "abcdefghijklmnopqrstuvwxyz0123456789";
+
+// Nested groups, every other one starred: ((a|b)*c|c)a...
+std::string generateNesting(size_t n) {
+  std::string res = "a";
+  for (size_t i = 0; i < n; ++i) {
+    res = "(" + res + "|" + SYMBOLS[(i + 1) % 3] + ")";
+    if (i % 2 == 0) {
+      res += "*";
+    }
+    res += SYMBOLS[(i + 2) % 3];
+  }
+  return res;
+}
+
+// One long word over a small alphabet
+std::string generateConcatenation(size_t n) {
+  std::mt19937 random(n);
+  std::string res{};
+  for (size_t i = 0; i < n; ++i) {
+    res += SYMBOLS[random() % 3];
+  }
+  return res;
+}
+
+// Distinct three-symbol words: aaa|bab|cac|...
+std::string generateAlternation(size_t n) {
+  std::string res{};
+  for (size_t i = 0; i < n; ++i) {
+    if (i > 0) {
+      res += "|";
+    }
+    res += SYMBOLS[i % SYMBOLS.size()];
+    res += SYMBOLS[i / SYMBOLS.size() % SYMBOLS.size()];
+    res += SYMBOLS[i % 7];
+  }
+  return res;
+}
+
+// Distinct heads leading into identical tails: c(a|b)*|d(a|b)*|...
+std::string generateHeads(size_t n) {
+  const std::string heads = SYMBOLS.substr(2);
+  std::string res{};
+  for (size_t i = 0; i < n && i < heads.size(); ++i) {
+    if (i > 0) {
+      res += "|";
+    }
+    res += heads[i] + std::string("(a|b)*");
+  }
+  return res;
+}
+
+// Stacked stars: (a|aa)*(a|aa)*...
+std::string generateStars(size_t n) { return repeatString("(a|aa)*", n); }
+
+// (a|b)*a(a|b)^n, which needs 2^(n+1) states
+std::string generateExponential(size_t n) {
+  return "(a|b)*a" + repeatString("(a|b)", n);
+}
+
+// One group repeated with a separator: (a|b|c)d(a|b|c)d...
+std::string generateGroups(size_t n) { return repeatString("(a|b|c)d", n); }
+
+// Character classes as in token patterns: (letter|digit)*, then n classes
+// alternating between letters and digits
+std::string generateClasses(size_t n) {
+  auto oneOf = [](const std::string &symbols) {
+    std::string res = "(";
+    for (char c : symbols) {
+      res += c;
+      res += '|';
+    }
+    res.back() = ')';
+    return res;
+  };
+  const std::string letters = oneOf(SYMBOLS.substr(0, 26));
+  const std::string digits = oneOf(SYMBOLS.substr(26));
+  std::string res = "(" + letters + "|" + digits + ")*";
+  for (size_t i = 0; i < n; ++i) {
+    res += i % 2 == 0 ? letters : digits;
+  }
+  return res;
+}
+
+struct Family {
+  const char *name;
+  std::string (*generate)(size_t n);
+  std::vector<size_t> sizes;
+};
+
+// Flat JSON object built field by field
+struct JsonObject {
+
+  std::string body{};
+
+  JsonObject &add(const std::string &key, const std::string &value) {
+    field(key);
+    body += '"';
+    for (char c : value) {
+      if (c == '"' || c == '\\') {
+        body += '\\';
+      }
+      body += c;
+    }
+    body += '"';
+    return *this;
+  }
+
+  JsonObject &add(const std::string &key, size_t value) {
+    field(key);
+    body += std::to_string(value);
+    return *this;
+  }
+
+  JsonObject &add(const std::string &key, double value) {
+    field(key);
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.6g", value);
+    body += buffer;
+    return *this;
+  }
+
+  void field(const std::string &key) {
+    if (!body.empty()) {
+      body += ", ";
+    }
+    body += '"' + key + "\": ";
+  }
+};
+
+void writeSection(std::ostream &out, const std::string &name,
+                  const std::vector<JsonObject> &rows, bool last = false) {
+  out << "  \"" << name << "\": [";
+  for (size_t i = 0; i < rows.size(); ++i) {
+    out << (i > 0 ? ",\n    " : "\n    ") << "{" << rows[i].body << "}";
+  }
+  out << "\n  ]" << (last ? "\n" : ",\n");
+}
+
+int main(int argc, char **argv) {
+  // The largest size of each family is close to the 1000 character limit
+  const std::vector<Family> families = {
+      {"nesting", generateNesting, {4, 16, 64, 166}},
+      {"concatenation", generateConcatenation, {10, 100, 1000}},
+      {"alternation", generateAlternation, {8, 64, 250}},
+      {"heads", generateHeads, {2, 8, 16, 34}},
+      {"stars", generateStars, {2, 8, 32, 142}},
+      {"exponential", generateExponential, {2, 4, 6, 8, 10, 12}},
+      {"classes", generateClasses, {1, 4, 12, 24}},
+  };
+  const int repeats = 5;
+
+  std::ofstream outfile(argc > 1 ? argv[1] : "re2dfa_bench.json");
+  outfile << "{\n";
+
+  // Every phase of the default pipeline on its own, averaged over repeats
+  std::vector<JsonObject> compileRows{};
+  CompileContext context{};
+  for (const auto &family : families) {
+    for (size_t n : family.sizes) {
+      std::string regex = family.generate(n);
+      int32_t root = NO_NODE;
+      CompactDFA dfa{};
+      CompactDFA minimized{};
+      CompactDFA numeric{};
+      DFA result = DFA(Alphabet("a"));
+      std::string text{};
+      std::string buffer{};
+
+      auto start = benchClock::now();
+      for (int i = 0; i < repeats; ++i) {
+        root = Parser(regex, context.arena).parse();
+      }
+      double parseTime = millisecondsSince(start) / repeats;
+
+      start = benchClock::now();
+      for (int i = 0; i < repeats; ++i) {
+        dfa = context.construct(root);
+      }
+      double subsetTime = millisecondsSince(start) / repeats;
+
+      start = benchClock::now();
+      for (int i = 0; i < repeats; ++i) {
+        minimized = minimize(dfa);
+      }
+      double minimizeTime = millisecondsSince(start) / repeats;
+
+      start = benchClock::now();
+      for (int i = 0; i < repeats; ++i) {
+        result = dfa.toDFA();
+      }
+      double toDFATime = millisecondsSince(start) / repeats;
+
+      start = benchClock::now();
+      for (int i = 0; i < repeats; ++i) {
+        text = result.to_string();
+      }
+      double toStringTime = millisecondsSince(start) / repeats;
+
+      start = benchClock::now();
+      for (int i = 0; i < repeats; ++i) {
+        dfa.write(buffer);
+      }
+      double writeTime = millisecondsSince(start) / repeats;
+
+      // The same automaton with numeric state ids instead of position sets
+      start = benchClock::now();
+      for (int i = 0; i < repeats; ++i) {
+        numeric = context.construct(root, false);
+      }
+      double numericSubsetTime = millisecondsSince(start) / repeats;
+
+      start = benchClock::now();
+      for (int i = 0; i < repeats; ++i) {
+        numeric.write(buffer);
+      }
+      double numericWriteTime = millisecondsSince(start) / repeats;
+
+      compileRows.push_back(JsonObject{}
+                                .add("family", family.name)
+                                .add("n", n)
+                                .add("length", regex.size())
+                                .add("positions", context.arena.positionCount())
+                                .add("columns", dfa.columns())
+                                .add("states", dfa.stateCount)
+                                .add("minimized", minimized.stateCount)
+                                .add("output_bytes", text.size())
+                                .add("parse_ms", parseTime)
+                                .add("subset_ms", subsetTime)
+                                .add("minimize_ms", minimizeTime)
+                                .add("to_dfa_ms", toDFATime)
+                                .add("to_string_ms", toStringTime)
+                                .add("write_ms", writeTime)
+                                .add("numeric_subset_ms", numericSubsetTime)
+                                .add("numeric_write_ms", numericWriteTime));
+    }
+  }
+  writeSection(outfile, "compile", compileRows);
+
+  // Parsing with and without hash-consing of subtrees into shared shapes.
+  // per_node_set_bytes is what firstpos and lastpos would take stored at
+  // full width for every node.
+  std::vector<JsonObject> hashConsingRows{};
+  const std::vector<std::pair<const char *, std::string>> repetitive = {
+      {"groups", generateGroups(125)},
+      {"stars", generateStars(142)},
+      {"alternation", generateAlternation(250)},
+      {"nesting", generateNesting(166)},
+  };
+  for (const auto &pattern : repetitive) {
+    JsonObject row{};
+    row.add("family", pattern.first).add("length", pattern.second.size());
+    for (bool share : {false, true}) {
+      context.arena.shareShapes = share;
+      const int parses = 50;
+      auto start = benchClock::now();
+      for (int i = 0; i < parses; ++i) {
+        Parser(pattern.second, context.arena).parse();
+      }
+      double parseTime = millisecondsSince(start) / parses;
+      const NodeArena &arena = context.arena;
+      if (share) {
+        row.add("nodes", arena.nodes.size())
+            .add("per_node_set_bytes",
+                 arena.nodes.size() * 2 * arena.wordsPerSet * sizeof(uint64_t))
+            .add("shapes", arena.shapes.size())
+            .add("shared_bytes", arena.analysisBytes())
+            .add("shared_parse_ms", parseTime);
+      } else {
+        row.add("unshared_bytes", arena.analysisBytes())
+            .add("unshared_parse_ms", parseTime);
+      }
+    }
+    hashConsingRows.push_back(row);
+  }
+  context.arena.shareShapes = true;
+  writeSection(outfile, "hash_consing", hashConsingRows);
+
+  // Matcher throughput on inputs built from words that never lead into the
+  // dead state
+  const std::vector<std::pair<std::string, std::vector<std::string>>>
+      patterns = {
+          {"(a|b)*a(a|b)(a|b)(a|b)", {"a", "b"}},
+          {"(a|b|c|d)*", {"a", "b", "c", "d"}},
+          {"((ab|ba)*|c)*", {"ab", "ba", "c"}},
+      };
+  const size_t inputSize = 64 << 20;
+  std::mt19937 random(42);
+  std::vector<JsonObject> matcherRows{};
+  for (const auto &pattern : patterns) {
+    Matcher matcher(minimize(context.build(pattern.first)));
+    const auto &words = pattern.second;
+    std::string input{};
+    input.reserve(inputSize + 2);
+    while (input.size() < inputSize) {
+      input += words[random() % words.size()];
+    }
+
+    auto start = benchClock::now();
+    bool matched = false;
+    for (int i = 0; i < repeats; ++i) {
+      matched ^= matcher.match(input);
+    }
+    double matchTime = millisecondsSince(start) / repeats;
+
+    start = benchClock::now();
+    ptrdiff_t longest = 0;
+    for (int i = 0; i < repeats; ++i) {
+      longest += matcher.longestMatch(input);
+    }
+    double longestTime = millisecondsSince(start) / repeats;
+
+    matcherRows.push_back(
+        JsonObject{}
+            .add("pattern", pattern.first)
+            .add("bytes", input.size())
+            .add("match_gbps", input.size() / matchTime / 1e6)
+            .add("longest_match_gbps", input.size() / longestTime / 1e6));
+    // Keep the results alive so the loops are not optimized away
+    if (matched && longest < 0) {
+      std::cerr << "unreachable" << std::endl;
+    }
+  }
+  writeSection(outfile, "matcher", matcherRows);
+
+  // Parallel construction on a wide alphabet. (any)*a(any)^10 alone puts
+  // every symbol but a into one column, so an alternative made of six
+  // classes, the i-th holding the symbols whose index has bit i set, tells
+  // all of them apart without adding states of note.
+  std::vector<JsonObject> parallelRows{};
+  {
+    auto oneOf = [](const std::string &symbols) {
+      std::string res = "(";
+      for (char c : symbols) {
+        res += c;
+        res += '|';
+      }
+      res.back() = ')';
+      return res;
+    };
+    const std::string any = oneOf(SYMBOLS);
+    std::string pattern = any + "*a" + repeatString(any, 10) + "|";
+    for (size_t bit = 0; bit < 6; ++bit) {
+      std::string members{};
+      for (size_t i = 0; i < SYMBOLS.size(); ++i) {
+        if (i >> bit & 1) {
+          members += SYMBOLS[i];
+        }
+      }
+      pattern += oneOf(members);
+    }
+    PositionAutomaton automaton = context.positions(pattern);
+    for (size_t threads = 1;
+         threads <= std::max(1u, std::thread::hardware_concurrency());
+         threads *= 2) {
+      auto start = benchClock::now();
+      CompactDFA dfa = buildParallel(automaton, threads);
+      double buildTime = millisecondsSince(start);
+      parallelRows.push_back(JsonObject{}
+                                 .add("length", pattern.size())
+                                 .add("columns", automaton.columns())
+                                 .add("threads", threads)
+                                 .add("states", dfa.stateCount)
+                                 .add("build_ms", buildTime));
+    }
+  }
+  writeSection(outfile, "parallel", parallelRows);
+
+  // Lazy DFA on exponential patterns whose full DFA is out of reach
+  std::vector<JsonObject> lazyRows{};
+  for (size_t n : {12, 20, 30}) {
+    std::string pattern = generateExponential(n);
+    std::string input{};
+    input.reserve(inputSize);
+    while (input.size() < inputSize) {
+      input += "ab"[random() % 2];
+    }
+    for (size_t budget : {64 << 10, 8 << 20}) {
+      LazyDFA lazy(context.positions(pattern), budget);
+      auto start = benchClock::now();
+      bool matched = lazy.match(input);
+      double matchTime = millisecondsSince(start);
+      lazyRows.push_back(
+          JsonObject{}
+              .add("pattern", pattern)
+              .add("budget_bytes", budget)
+              .add("states", lazy.stateCount)
+              .add("flushes", lazy.flushes)
+              .add("match_gbps", input.size() / matchTime / 1e6));
+      if (matched && lazy.stateCount == 0) {
+        std::cerr << "unreachable" << std::endl;
+      }
+    }
+  }
+  writeSection(outfile, "lazy", lazyRows);
+
+  // Bit-parallel simulation, which compiles in time linear in the pattern
+  // whatever the size of its DFA
+  std::vector<JsonObject> bitParallelRows{};
+  for (const std::string &pattern :
+       {generateExponential(12), generateExponential(30),
+        generateExponential(100), generateExponential(190)}) {
+    std::string input{};
+    input.reserve(inputSize);
+    while (input.size() < inputSize) {
+      input += "ab"[random() % 2];
+    }
+
+    auto start = benchClock::now();
+    BitParallelMatcher matcher(context.positions(pattern));
+    double compileTime = millisecondsSince(start);
+
+    start = benchClock::now();
+    bool matched = matcher.match(input);
+    double matchTime = millisecondsSince(start);
+    bitParallelRows.push_back(
+        JsonObject{}
+            .add("length", pattern.size())
+            .add("positions", context.arena.positionCount())
+            .add("table_bytes", (matcher.symbolMasks.size() +
+                                 matcher.followTable.size()) *
+                                    sizeof(uint64_t))
+            .add("compile_ms", compileTime)
+            .add("match_gbps", input.size() / matchTime / 1e6));
+    if (matched && compileTime < 0) {
+      std::cerr << "unreachable" << std::endl;
+    }
+  }
+  writeSection(outfile, "bit_parallel", bitParallelRows);
+
+  // Many patterns over the same lines: one matcher per pattern against one
+  // combined automaton that reports every matching pattern in a single pass
+  std::vector<JsonObject> multiPatternRows{};
+  for (size_t n : {4, 16, 64}) {
+    std::vector<std::string> patterns{};
+    for (size_t i = 0; i < n; ++i) {
+      patterns.push_back(std::string(1, SYMBOLS[i % SYMBOLS.size()]) +
+                         "(a|b|c)*" + SYMBOLS[i * 7 % SYMBOLS.size()]);
+    }
+    std::vector<std::string> lines(1 << 18);
+    for (std::string &line : lines) {
+      line += SYMBOLS[random() % n % SYMBOLS.size()];
+      for (size_t i = random() % 16; i > 0; --i) {
+        line += "abc"[random() % 3];
+      }
+      line += SYMBOLS[random() % SYMBOLS.size()];
+    }
+
+    auto start = benchClock::now();
+    std::vector<Matcher> separate{};
+    for (const std::string &pattern : patterns) {
+      separate.emplace_back(minimize(context.build(pattern)));
+    }
+    double separateCompileTime = millisecondsSince(start);
+
+    start = benchClock::now();
+    size_t separateHits = 0;
+    for (const std::string &line : lines) {
+      for (const Matcher &matcher : separate) {
+        separateHits += matcher.match(line);
+      }
+    }
+    double separateTime = millisecondsSince(start);
+
+    start = benchClock::now();
+    MultiMatcher combined(minimize(context.buildPatterns(patterns)));
+    double combinedCompileTime = millisecondsSince(start);
+
+    start = benchClock::now();
+    size_t combinedHits = 0;
+    for (const std::string &line : lines) {
+      const uint64_t *ids = combined.match(line);
+      for (size_t i = 0; i < combined.patternWords; ++i) {
+        combinedHits += __builtin_popcountll(ids[i]);
+      }
+    }
+    double combinedTime = millisecondsSince(start);
+
+    multiPatternRows.push_back(
+        JsonObject{}
+            .add("patterns", n)
+            .add("lines", lines.size())
+            .add("states", combined.matcher.rows - 1)
+            .add("separate_compile_ms", separateCompileTime)
+            .add("combined_compile_ms", combinedCompileTime)
+            .add("separate_match_ms", separateTime)
+            .add("combined_match_ms", combinedTime)
+            .add("hits", combinedHits));
+    if (separateHits != combinedHits) {
+      std::cerr << "multi-pattern hits differ: " << separateHits << " vs "
+                << combinedHits << std::endl;
+    }
+  }
+  writeSection(outfile, "multi_pattern", multiPatternRows);
+
+  // Equivalence checks: building both minimal DFAs against a lazy search of
+  // the symmetric difference, once for a pair that differs on a short word
+  // and once for an equal pair, which has to be explored completely
+  std::vector<JsonObject> productRows{};
+  for (size_t n : {8, 12}) {
+    std::string regex = generateExponential(n);
+    std::string differs = regex + "|c";
+    std::string equal = "(b|a)*a" + repeatString("(b|a)", n);
+
+    auto start = benchClock::now();
+    CompactDFA first = minimize(context.build(regex));
+    CompactDFA second = minimize(context.build(differs));
+    double buildTime = millisecondsSince(start);
+
+    start = benchClock::now();
+    LazyDFA lazy(context.positions(regex));
+    LazyDFA lazyDiffers(context.positions(differs));
+    WordSearch early = findWord(lazy, lazyDiffers,
+                                ProductOperation::SYMMETRIC_DIFFERENCE);
+    double differsTime = millisecondsSince(start);
+
+    start = benchClock::now();
+    LazyDFA lazyEqual(context.positions(equal));
+    WordSearch full = findWord(lazy, lazyEqual,
+                               ProductOperation::SYMMETRIC_DIFFERENCE);
+    double equalTime = millisecondsSince(start);
+
+    productRows.push_back(JsonObject{}
+                              .add("pattern", regex)
+                              .add("states", first.stateCount +
+                                                 second.stateCount)
+                              .add("build_both_ms", buildTime)
+                              .add("differs_ms", differsTime)
+                              .add("differs_pairs", early.pairs)
+                              .add("witness", early.witness)
+                              .add("equal_ms", equalTime)
+                              .add("equal_pairs", full.pairs));
+    if (!early.found || full.found) {
+      std::cerr << "product search failed for " << regex << std::endl;
+    }
+  }
+  writeSection(outfile, "product", productRows);
+
+  // Many strings against one matcher: one at a time against eight in
+  // lockstep
+  struct Lengths {
+    size_t shortest;
+    size_t longest;
+    size_t count;
+  };
+  std::vector<JsonObject> matchManyRows{};
+  Matcher matcher(minimize(context.build(generateClasses(4))));
+  for (Lengths lengths : {Lengths{4, 16, 1 << 20}, Lengths{16, 64, 1 << 18},
+                          Lengths{256, 1024, 1 << 12}}) {
+    std::mt19937 random(lengths.count);
+    std::vector<std::string> strings(lengths.count);
+    for (std::string &s : strings) {
+      size_t length = lengths.shortest +
+                      random() % (lengths.longest - lengths.shortest + 1);
+      for (size_t i = 0; i < length; ++i) {
+        s += SYMBOLS[random() % SYMBOLS.size()];
+      }
+    }
+    std::vector<std::string_view> inputs(strings.begin(), strings.end());
+
+    auto start = benchClock::now();
+    size_t loopHits = 0;
+    for (std::string_view input : inputs) {
+      loopHits += matcher.match(input);
+    }
+    double loopTime = millisecondsSince(start);
+
+    std::vector<uint64_t> bits{};
+    auto countHits = [&bits]() {
+      size_t res = 0;
+      for (uint64_t word : bits) {
+        res += __builtin_popcountll(word);
+      }
+      return res;
+    };
+    start = benchClock::now();
+    matcher.matchMany(inputs.data(), inputs.size(), bits);
+    double interleavedTime = millisecondsSince(start);
+    size_t interleavedHits = countHits();
+
+    matchManyRows.push_back(JsonObject{}
+                                .add("shortest", lengths.shortest)
+                                .add("longest", lengths.longest)
+                                .add("strings", inputs.size())
+                                .add("loop_ms", loopTime)
+                                .add("interleaved_ms", interleavedTime)
+                                .add("hits", loopHits));
+    if (interleavedHits != loopHits) {
+      std::cerr << "match_many hits differ: " << loopHits << " vs "
+                << interleavedHits << std::endl;
+    }
+  }
+  writeSection(outfile, "match_many", matchManyRows);
+
+  // Compile cache: a cold build and store against loading the mapped file.
+  // The cache lives in a fresh temporary directory, removed afterwards.
+  std::vector<JsonObject> cacheRows{};
+  std::filesystem::path cacheDirectory =
+      std::filesystem::temp_directory_path() /
+      ("re2dfa_bench." + std::to_string(std::random_device()()));
+  CompileCache cache{cacheDirectory.string()};
+  for (size_t n : {8, 12}) {
+    std::string pattern = generateExponential(n);
+    std::string key = CompileCache::keyFor(pattern, true);
+
+    auto start = benchClock::now();
+    Matcher matcher(minimize(context.build(pattern)));
+    double compileTime = millisecondsSince(start);
+
+    start = benchClock::now();
+    cache.store(key, matcher);
+    double storeTime = millisecondsSince(start);
+
+    start = benchClock::now();
+    MappedDFA mapped{};
+    bool loaded = cache.load(key, mapped);
+    double loadTime = millisecondsSince(start);
+
+    cacheRows.push_back(JsonObject{}
+                            .add("pattern", pattern)
+                            .add("states", matcher.rows - 1)
+                            .add("compile_ms", compileTime)
+                            .add("store_ms", storeTime)
+                            .add("load_ms", loaded ? loadTime : -1.0));
+  }
+  writeSection(outfile, "cache", cacheRows, true);
+  std::error_code error{};
+  std::filesystem::remove_all(cacheDirectory, error);
+
+  outfile << "}\n";
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <vector>
+
+#include "re2dfa.hpp"
+
+// Sets up to this many words are kept on the stack while matching
+constexpr size_t STACK_WORDS = 16;
+
+BitParallelMatcher::BitParallelMatcher(const PositionAutomaton &automaton)
+    : wordsPerSet(automaton.wordsPerSet),
+      positionCount(automaton.positionCount), initial(automaton.initial),
+      finalMask(automaton.wordsPerSet, 0),
+      symbolMasks(256 * automaton.wordsPerSet, 0),
+      followTable(automaton.wordsPerSet * 8 * 256 * automaton.wordsPerSet, 0) {
+  // End markers are not in the alphabet, so no byte ever reads them
+  for (int32_t pos : automaton.endPositions) {
+    PositionSet::insert(finalMask.data(), pos);
+  }
+  for (unsigned char c : automaton.alphabet) {
+    const uint64_t *positions = automaton.positionsOf(automaton.columnOf[c]);
+    std::copy(positions, positions + wordsPerSet,
+              &symbolMasks[c * wordsPerSet]);
+  }
+
+  // Every row extends the row without its lowest bit by one followpos set
+  for (size_t chunk = 0; chunk < wordsPerSet * 8; ++chunk) {
+    uint64_t *rows = &followTable[chunk * 256 * wordsPerSet];
+    for (size_t b = 1; b < 256; ++b) {
+      size_t pos = chunk * 8 + __builtin_ctz(b);
+      uint64_t *row = &rows[b * wordsPerSet];
+      std::copy(&rows[(b & (b - 1)) * wordsPerSet],
+                &rows[(b & (b - 1)) * wordsPerSet] + wordsPerSet, row);
+      if (pos < automaton.positionCount) {
+        PositionSet::unite(row, automaton.followposOf(pos), wordsPerSet);
+      }
+    }
+  }
+}
+
+bool BitParallelMatcher::match(std::string_view input) const {
+  const uint64_t *masks = symbolMasks.data();
+  const uint64_t *table = followTable.data();
+
+  // A single word is stepped without branches, one lookup per chunk that
+  // holds positions
+  if (wordsPerSet == 1) {
+    const size_t chunks = (positionCount + 7) / 8;
+    uint64_t state = initial[0];
+    for (char c : input) {
+      uint64_t read = state & masks[static_cast<unsigned char>(c)];
+      state = 0;
+      for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        state |= table[chunk * 256 + ((read >> (chunk * 8)) & 0xFF)];
+      }
+      if (state == 0) {
+        return false;
+      }
+    }
+    return (state & finalMask[0]) != 0;
+  }
+
+  std::vector<uint64_t> heap{};
+  uint64_t stack[2 * STACK_WORDS];
+  uint64_t *state = stack;
+  if (wordsPerSet > STACK_WORDS) {
+    heap.resize(2 * wordsPerSet);
+    state = heap.data();
+  }
+  uint64_t *next = state + wordsPerSet;
+  std::copy(initial.begin(), initial.end(), state);
+
+  for (char c : input) {
+    const uint64_t *mask = &masks[static_cast<unsigned char>(c) * wordsPerSet];
+    std::fill(next, next + wordsPerSet, 0);
+    bool alive = false;
+    for (size_t i = 0; i < wordsPerSet; ++i) {
+      uint64_t read = state[i] & mask[i];
+      while (read) {
+        size_t shift = __builtin_ctzll(read) & ~size_t(7);
+        size_t row = (i * 8 + shift / 8) * 256 + ((read >> shift) & 0xFF);
+        PositionSet::unite(next, &table[row * wordsPerSet], wordsPerSet);
+        read &= ~(uint64_t(0xFF) << shift);
+        alive = true;
+      }
+    }
+    if (!alive) {
+      return false;
+    }
+    std::swap(state, next);
+  }
+  for (size_t i = 0; i < wordsPerSet; ++i) {
+    if (state[i] & finalMask[i]) {
+      return true;
+    }
+  }
+  return false;
+}
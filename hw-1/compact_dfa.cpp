@@ -0,0 +1,70 @@
+#include <charconv>
+#include <string>
+#include <vector>
+
+#include "api.hpp"
+#include "re2dfa.hpp"
+
+DFA CompactDFA::toDFA() const {
+  auto res = DFA(Alphabet(alphabet));
+
+  std::vector<std::string> stateNames{};
+  stateNames.reserve(stateCount);
+  for (uint32_t state = 0; state < stateCount; ++state) {
+    stateNames.push_back(stateName(state));
+    res.create_state(stateNames.back(), isFinal(state));
+  }
+  if (stateCount > 0) {
+    res.set_initial(stateNames[0]);
+  }
+
+  for (uint32_t state = 0; state < stateCount; ++state) {
+    for (char c : alphabet) {
+      uint32_t to = nextBySymbol(state, c);
+      if (to != DEAD_STATE) {
+        res.set_trans(stateNames[state], c, stateNames[to]);
+      }
+    }
+  }
+
+  return res;
+}
+
+void CompactDFA::write(std::string &out) const {
+  out.clear();
+  out += alphabet;
+  out += '\n';
+
+  char buffer[16];
+  auto appendName = [this, &out, &buffer](uint32_t state) {
+    if (names.empty()) {
+      auto res = std::to_chars(buffer, buffer + sizeof(buffer), state);
+      out.append(buffer, res.ptr);
+    } else {
+      out += names[state];
+    }
+  };
+
+  // The initial state is state 0, so creation order already lists it first
+  for (uint32_t state = 0; state < stateCount; ++state) {
+    out += isFinal(state) ? "[[" : "[";
+    appendName(state);
+    out += isFinal(state) ? "]]\n" : "]\n";
+  }
+
+  for (uint32_t state = 0; state < stateCount; ++state) {
+    for (char c : alphabet) {
+      uint32_t to = nextBySymbol(state, c);
+      if (to == DEAD_STATE) {
+        continue;
+      }
+      out += '[';
+      appendName(state);
+      out += "] ";
+      out += c;
+      out += " [";
+      appendName(to);
+      out += "]\n";
+    }
+  }
+}
@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "re2dfa.hpp"
+
+// Byte range of one file that starts at a line start and ends after a '\n'
+// or at the end of the file
+struct Chunk {
+  size_t file;
+  size_t begin;
+  size_t end;
+};
+
+struct ChunkResult {
+  std::string output{};
+  size_t count = 0;
+  bool done = false;
+};
+
+std::vector<Chunk> splitIntoChunks(const std::vector<MappedFile> &files,
+                                   size_t chunkSize) {
+  std::vector<Chunk> chunks{};
+  for (size_t file = 0; file < files.size(); ++file) {
+    const MappedFile &mapped = files[file];
+    size_t begin = 0;
+    while (begin < mapped.size) {
+      size_t end = std::min(begin + chunkSize, mapped.size);
+      if (end < mapped.size) {
+        const void *newline =
+            std::memchr(mapped.data + end, '\n', mapped.size - end);
+        end = newline == nullptr
+                  ? mapped.size
+                  : static_cast<const char *>(newline) - mapped.data + 1;
+      }
+      chunks.push_back(Chunk{file, begin, end});
+      begin = end;
+    }
+  }
+  return chunks;
+}
+
+// Lines are matched whole, as with grep -x: the matchers are anchored at
+// both ends and a line is reported only if it is a word of the language.
+template <typename M>
+void scanChunk(M &matcher, const MappedFile &file,
+               const Chunk &chunk, bool countOnly, bool withFileName,
+               ChunkResult &result) {
+  const char *it = file.data + chunk.begin;
+  const char *end = file.data + chunk.end;
+  while (it < end) {
+    const char *newline =
+        static_cast<const char *>(std::memchr(it, '\n', end - it));
+    const char *lineEnd = newline == nullptr ? end : newline;
+    if (matcher.match(std::string_view(it, lineEnd - it))) {
+      ++result.count;
+      if (!countOnly) {
+        if (withFileName) {
+          result.output += file.path;
+          result.output += ':';
+        }
+        result.output.append(it, lineEnd - it);
+        result.output += '\n';
+      }
+    }
+    it = lineEnd + 1;
+  }
+}
+
+int usage(const char *name) {
+  std::cerr << "Usage: " << name
+            << " [-c] [-j threads] [--lazy bytes | --bit-parallel]"
+               " [--max-states n] [--max-bytes n] regex file...\n"
+               "Prints the lines of the files that regex matches as a whole,"
+               " like grep -x;\n"
+               "a line that merely contains a match is not printed. With -c"
+               " only the number\n"
+               "of such lines is printed."
+            << std::endl;
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  bool countOnly = false;
+  size_t lazyBudget = 0;
+  bool bitParallel = false;
+  CompileOptions options{};
+  options.fallback = true;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-'; ++i) {
+    std::string arg = argv[i];
+    bool valid = true;
+    if (arg == "-c") {
+      countOnly = true;
+    } else if (arg == "-j" && i + 1 < argc) {
+      valid = parseCount(argv[++i], MAX_THREADS, threads) && threads > 0;
+    } else if (arg == "--lazy" && i + 1 < argc) {
+      valid = parseCount(argv[++i], SIZE_MAX, lazyBudget) && lazyBudget > 0;
+    } else if (arg == "--bit-parallel") {
+      bitParallel = true;
+    } else if (arg == "--max-states" && i + 1 < argc) {
+      valid = parseCount(argv[++i], SIZE_MAX, options.maxStates) &&
+              options.maxStates > 0;
+    } else if (arg == "--max-bytes" && i + 1 < argc) {
+      valid = parseCount(argv[++i], SIZE_MAX, options.maxBytes) &&
+              options.maxBytes > 0;
+    } else {
+      valid = false;
+    }
+    if (!valid) {
+      return usage(argv[0]);
+    }
+  }
+  if (argc - i < 2) {
+    return usage(argv[0]);
+  }
+
+  // With --lazy the full DFA is never built: every worker runs its own lazy
+  // DFA over the shared position automaton within the given cache budget.
+  // --bit-parallel shares one simulation of the position automaton instead,
+  // and so does a DFA that would pass --max-states or --max-bytes.
+  CompileContext context{};
+  PositionAutomaton automaton{};
+  std::unique_ptr<Matcher> matcher{};
+  std::unique_ptr<BitParallelMatcher> simulation{};
+  if (lazyBudget > 0) {
+    automaton = context.positions(argv[i++]);
+  } else if (bitParallel) {
+    simulation =
+        std::make_unique<BitParallelMatcher>(context.positions(argv[i++]));
+  } else {
+    CompileResult result = context.tryBuild(argv[i++], options);
+    if (result.ok()) {
+      matcher = std::make_unique<Matcher>(minimize(result.dfa));
+    } else if (result.fallback != nullptr) {
+      simulation = std::move(result.fallback);
+    } else {
+      std::cerr << argv[0] << ": construction stopped: "
+                << statusName(result.status) << ", and the fallback matcher"
+                << " needs " << result.fallbackBytes
+                << " bytes, more than --max-bytes" << std::endl;
+      return 2;
+    }
+  }
+
+  std::vector<MappedFile> files{};
+  for (; i < argc; ++i) {
+    files.emplace_back(argv[i]);
+    if (!files.back().open()) {
+      std::cerr << argv[0] << ": " << argv[i] << ": " << std::strerror(errno)
+                << std::endl;
+      return 2;
+    }
+  }
+  bool withFileName = files.size() > 1;
+
+  const size_t chunkSize = 4 << 20;
+  std::vector<Chunk> chunks = splitIntoChunks(files, chunkSize);
+
+  // Workers claim chunks in order but may run at most window chunks ahead of
+  // the writer, which bounds the memory held by pending output.
+  const size_t window = threads * 4;
+  std::vector<ChunkResult> results(window);
+  std::mutex mutex{};
+  std::condition_variable changed{};
+  size_t nextChunk = 0;
+  size_t written = 0;
+
+  std::vector<std::thread> workers{};
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&]() {
+      std::unique_ptr<LazyDFA> lazy{};
+      if (lazyBudget > 0) {
+        lazy = std::make_unique<LazyDFA>(automaton, lazyBudget);
+      }
+      while (true) {
+        size_t index;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          changed.wait(lock, [&]() {
+            return nextChunk >= chunks.size() || nextChunk < written + window;
+          });
+          if (nextChunk >= chunks.size()) {
+            return;
+          }
+          index = nextChunk++;
+        }
+        ChunkResult result{};
+        const Chunk &chunk = chunks[index];
+        if (lazy != nullptr) {
+          scanChunk(*lazy, files[chunk.file], chunk, countOnly, withFileName,
+                    result);
+        } else if (simulation != nullptr) {
+          scanChunk(*simulation, files[chunk.file], chunk, countOnly,
+                    withFileName, result);
+        } else {
+          scanChunk(*matcher, files[chunk.file], chunk, countOnly,
+                    withFileName, result);
+        }
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          results[index % window] = std::move(result);
+          results[index % window].done = true;
+        }
+        changed.notify_all();
+      }
+    });
+  }
+
+  std::vector<size_t> fileCounts(files.size(), 0);
+  while (written < chunks.size()) {
+    ChunkResult result{};
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [&]() { return results[written % window].done; });
+      result = std::move(results[written % window]);
+      results[written % window] = ChunkResult{};
+    }
+    std::fwrite(result.output.data(), 1, result.output.size(), stdout);
+    fileCounts[chunks[written].file] += result.count;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ++written;
+    }
+    changed.notify_all();
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  size_t total = 0;
+  for (size_t file = 0; file < files.size(); ++file) {
+    total += fileCounts[file];
+    if (countOnly && withFileName) {
+      std::printf("%s:%zu\n", files[file].path.c_str(), fileCounts[file]);
+    }
+  }
+  if (countOnly && !withFileName) {
+    std::printf("%zu\n", total);
+  }
+  return total > 0 ? 0 : 1;
+}
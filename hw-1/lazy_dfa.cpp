@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "re2dfa.hpp"
+
+constexpr uint32_t EMPTY_BUCKET = UINT32_MAX;
+constexpr size_t INITIAL_BUCKETS = 16;
+
+LazyDFA::LazyDFA(PositionAutomaton automaton, size_t memoryBudget)
+    : automaton(std::move(automaton)) {
+  size_t words = this->automaton.wordsPerSet;
+  size_t columns = this->automaton.columns();
+  // A state costs its position set, its transition row, its final flag and
+  // up to four hash buckets
+  size_t bytesPerState = words * sizeof(uint64_t) +
+                         columns * sizeof(uint32_t) + 1 + 4 * sizeof(uint32_t);
+  maxStates = std::max<size_t>(memoryBudget / bytesPerState, 4);
+
+  // The budget only caps the cache. Tables grow with the states that are
+  // actually built, so a short search or match costs what it visits.
+  buckets.resize(INITIAL_BUCKETS);
+  flush();
+  flushes = 0;
+}
+
+void LazyDFA::flush() {
+  ++flushes;
+  // The buckets are at most four times as many as the states that filled
+  // them, so clearing them costs no more than building those states did
+  std::fill(buckets.begin(), buckets.end(), EMPTY_BUCKET);
+  stateCount = 0;
+  sets.assign(automaton.wordsPerSet, 0);
+  transitions.clear();
+  finals.clear();
+  PositionSet::unite(sets.data(), automaton.initial.data(),
+                     automaton.wordsPerSet);
+  findOrAdd(sets.data());
+}
+
+void LazyDFA::growBuckets() {
+  const size_t words = automaton.wordsPerSet;
+  buckets.assign(buckets.size() * 2, EMPTY_BUCKET);
+  const size_t mask = buckets.size() - 1;
+  for (uint32_t id = 0; id < stateCount; ++id) {
+    size_t i = PositionSet::hash(&sets[id * words], words) & mask;
+    while (buckets[i] != EMPTY_BUCKET) {
+      i = (i + 1) & mask;
+    }
+    buckets[i] = id;
+  }
+}
+
+// set must be the scratch slot that follows the last state, so adding it
+// only has to claim that slot.
+uint32_t LazyDFA::findOrAdd(const uint64_t *set) {
+  const size_t words = automaton.wordsPerSet;
+  const size_t mask = buckets.size() - 1;
+  for (size_t i = PositionSet::hash(set, words) & mask;; i = (i + 1) & mask) {
+    uint32_t id = buckets[i];
+    if (id == EMPTY_BUCKET) {
+      if (stateCount == maxStates) {
+        return UNKNOWN_STATE;
+      }
+      buckets[i] = stateCount;
+      transitions.resize(transitions.size() + automaton.columns(),
+                         UNKNOWN_STATE);
+      finals.push_back(automaton.isFinal(set));
+      ++stateCount;
+      // set may move from here on
+      sets.resize((stateCount + 1) * words, 0);
+      if (2 * stateCount > buckets.size()) {
+        growBuckets();
+      }
+      return stateCount - 1;
+    }
+    if (std::memcmp(&sets[id * words], set, words * sizeof(uint64_t)) == 0) {
+      return id;
+    }
+  }
+}
+
+uint32_t LazyDFA::computeNext(uint32_t state, size_t column) {
+  const size_t words = automaton.wordsPerSet;
+  uint64_t *scratch = &sets[stateCount * words];
+  automaton.step(&sets[state * words], column, scratch);
+  if (std::all_of(scratch, scratch + words,
+                  [](uint64_t word) { return word == 0; })) {
+    transitions[state * automaton.columns() + column] = DEAD_STATE;
+    return DEAD_STATE;
+  }
+
+  uint32_t to = findOrAdd(scratch);
+  if (to != UNKNOWN_STATE) {
+    transitions[state * automaton.columns() + column] = to;
+    return to;
+  }
+
+  // The cache is full. Keep only the initial state and the target; the
+  // transition into it is recomputed if the source is ever reached again.
+  std::vector<uint64_t> target(scratch, scratch + words);
+  flush();
+  std::copy(target.begin(), target.end(), sets.begin() + stateCount * words);
+  return findOrAdd(&sets[stateCount * words]);
+}
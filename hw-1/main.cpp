@@ -1,17 +1,247 @@
 #include "api.hpp"
+#include "re2dfa.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
-extern DFA re2dfa(const std::string& regExp);
+// Ends every record of batch output on a line of its own; it never occurs in
+// the text of an automaton
+constexpr char RECORD_SEPARATOR = '\x1e';
+
+// Formats the re2dfa.out text of line into text. Returns false, with the
+// reason in context.stats.status, if a limit was passed. A cache hit
+// compiles nothing, so of context.stats only writeMs is set then.
+bool compileToText(CompileContext &context, const std::string &line,
+                   const CompileOptions &options, const CompileCache *cache,
+                   std::string &text, bool &hit) {
+  hit = false;
+  // The cache stores state names along with the tables, so a hit prints
+  // exactly what a compilation would
+  std::string key{};
+  if (cache != nullptr) {
+    key = CompileCache::keyFor(line, options.minimize, options.named);
+    MappedDFA cached{};
+    hit = cache->load(key, cached);
+    if (hit) {
+      context.stats = CompileStats{};
+      PhaseTimer timer(context.stats.writeMs);
+      cached.toCompactDFA().write(text);
+      return true;
+    }
+  }
+
+  CompactDFA dfa = context.build(line, options);
+  if (context.stats.status != CompileStatus::OK) {
+    return false;
+  }
+  if (cache != nullptr && !cache->store(key, Matcher(dfa), dfa.names)) {
+    std::cerr << "Can't write cache entry " << cache->pathFor(key)
+              << std::endl;
+  }
+  PhaseTimer timer(context.stats.writeMs);
+  dfa.write(text);
+  return true;
+}
+
+// Counters of the last compileToText call for --stats. A cache hit
+// compiles nothing, so only its write time is reported.
+std::string statsText(const CompileContext &context, bool cached, bool hit) {
+  std::string res{};
+  if (cached) {
+    res += "cache_hit " + std::to_string(hit) + "\n";
+  }
+  if (hit) {
+    res += "write_ms " + std::to_string(context.stats.writeMs) + "\n";
+  } else {
+    res += context.stats.toString();
+  }
+  return res;
+}
+
+struct BatchRecord {
+  std::string text{};
+  std::string stats{};
+  bool done = false;
+};
+
+// Compiles every line of input as a regex and writes the records to stdout
+// in input order, and with printStats their counters to stderr, each ended
+// the same way. Workers read lines themselves but may run at most window
+// lines ahead of the writer, so memory stays bounded on any input length.
+// Each worker reuses one CompileContext, which holds all compiler state.
+void compileBatch(std::istream &input, const CompileOptions &options,
+                  const CompileCache *cache, size_t jobs, bool printStats) {
+  const size_t window = jobs * 4;
+  std::vector<BatchRecord> records(window);
+  std::mutex mutex{};
+  std::condition_variable changed{};
+  size_t nextLine = 0;
+  size_t written = 0;
+  bool exhausted = false;
+
+  std::vector<std::thread> workers{};
+  for (size_t t = 0; t < jobs; ++t) {
+    workers.emplace_back([&]() {
+      CompileContext context{};
+      std::string line{};
+      while (true) {
+        size_t index;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          changed.wait(lock, [&]() {
+            return exhausted || nextLine < written + window;
+          });
+          if (exhausted || !std::getline(input, line)) {
+            exhausted = true;
+            changed.notify_all();
+            return;
+          }
+          index = nextLine++;
+        }
+        BatchRecord record{};
+        bool hit = false;
+        if (!compileToText(context, line, options, cache, record.text, hit)) {
+          record.text = "error ";
+          record.text += statusName(context.stats.status);
+          record.text += '\n';
+        }
+        record.text += RECORD_SEPARATOR;
+        record.text += '\n';
+        if (printStats) {
+          record.stats = statsText(context, cache != nullptr, hit);
+          record.stats += RECORD_SEPARATOR;
+          record.stats += '\n';
+        }
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          records[index % window] = std::move(record);
+          records[index % window].done = true;
+        }
+        changed.notify_all();
+      }
+    });
+  }
+
+  while (true) {
+    BatchRecord record{};
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [&]() {
+        return records[written % window].done ||
+               (exhausted && written == nextLine);
+      });
+      if (!records[written % window].done) {
+        break;
+      }
+      record = std::move(records[written % window]);
+      records[written % window] = BatchRecord{};
+    }
+    std::fwrite(record.text.data(), 1, record.text.size(), stdout);
+    std::fwrite(record.stats.data(), 1, record.stats.size(), stderr);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ++written;
+    }
+    changed.notify_all();
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  std::fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  CompileOptions options{};
+  std::string cacheDirectory{};
+  std::string batchInput{};
+  size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+  bool printStats = false;
+  auto usage = [&]() {
+    std::cerr << "Usage: " << argv[0]
+              << " [--minimize] [--numeric] [--threads n] [--cache directory]"
+                 " [--stats] [--max-states n] [--max-bytes n] [--max-ms n]"
+                 " [--batch file|- [--jobs n]]"
+              << std::endl;
+    return 1;
+  };
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool valid = true;
+    if (arg == "--minimize") {
+      options.minimize = true;
+    } else if (arg == "--threads" && i + 1 < argc) {
+      valid = parseCount(argv[++i], MAX_THREADS, options.threads);
+    } else if (arg == "--cache" && i + 1 < argc) {
+      cacheDirectory = argv[++i];
+    } else if (arg == "--stats") {
+      printStats = true;
+    } else if (arg == "--numeric") {
+      options.named = false;
+    } else if (arg == "--max-states" && i + 1 < argc) {
+      valid = parseCount(argv[++i], SIZE_MAX, options.maxStates);
+    } else if (arg == "--max-bytes" && i + 1 < argc) {
+      valid = parseCount(argv[++i], SIZE_MAX, options.maxBytes);
+    } else if (arg == "--max-ms" && i + 1 < argc) {
+      valid = parseMilliseconds(argv[++i], options.maxMs);
+    } else if (arg == "--batch" && i + 1 < argc) {
+      batchInput = argv[++i];
+    } else if (arg == "--jobs" && i + 1 < argc) {
+      valid = parseCount(argv[++i], MAX_THREADS, jobs) && jobs > 0;
+    } else {
+      valid = false;
+    }
+    if (!valid) {
+      return usage();
+    }
+  }
+
+  std::unique_ptr<CompileCache> cache{};
+  if (!cacheDirectory.empty()) {
+    cache = std::make_unique<CompileCache>(CompileCache{cacheDirectory});
+  }
+
+  // A batch reads one regex per line and writes one record per line to
+  // stdout: the re2dfa.out text, or "error <status>" if a limit was passed
+  if (!batchInput.empty()) {
+    if (batchInput == "-") {
+      compileBatch(std::cin, options, cache.get(), jobs, printStats);
+      return 0;
+    }
+    std::ifstream batch(batchInput);
+    if (!batch) {
+      std::cerr << argv[0] << ": can't read " << batchInput << std::endl;
+      return 1;
+    }
+    compileBatch(batch, options, cache.get(), jobs, printStats);
+    return 0;
+  }
 
-int main() {
   std::ifstream infile("re2dfa.in");
   std::ofstream outfile("re2dfa.out");
 
   std::string line;
   std::getline(infile, line);
-  outfile << re2dfa(line).to_string();
 
+  // The whole output is formatted into one buffer and written at once
+  CompileContext context{};
+  std::string text{};
+  bool hit = false;
+  if (!compileToText(context, line, options, cache.get(), text, hit)) {
+    std::cerr << argv[0] << ": construction stopped: "
+              << statusName(context.stats.status) << std::endl;
+    return 1;
+  }
+  outfile.write(text.data(), text.size());
+
+  if (printStats) {
+    std::cerr << statsText(context, cache != nullptr, hit);
+  }
   return 0;
 }
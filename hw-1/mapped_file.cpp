@@ -0,0 +1,82 @@
+#include <fstream>
+#include <utility>
+
+#include "re2dfa.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+# define RE2DFA_HAVE_MMAP
+#endif
+
+MappedFile::MappedFile(MappedFile &&other) { *this = std::move(other); }
+
+MappedFile &MappedFile::operator=(MappedFile &&other) {
+  close();
+  path = std::move(other.path);
+  data = other.data;
+  size = other.size;
+  buffer = std::move(other.buffer);
+  mapped = other.mapped;
+  other.data = nullptr;
+  other.size = 0;
+  other.mapped = false;
+  return *this;
+}
+
+MappedFile::~MappedFile() { close(); }
+
+void MappedFile::close() {
+#ifdef RE2DFA_HAVE_MMAP
+  if (mapped) {
+    munmap(const_cast<char *>(data), size);
+  }
+#endif
+  buffer.clear();
+  data = nullptr;
+  size = 0;
+  mapped = false;
+}
+
+bool MappedFile::open() {
+  close();
+#ifdef RE2DFA_HAVE_MMAP
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info {};
+  if (fstat(fd, &info) != 0) {
+    ::close(fd);
+    return false;
+  }
+  size = info.st_size;
+  if (size > 0) {
+    void *memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (memory == MAP_FAILED) {
+      ::close(fd);
+      size = 0;
+      return false;
+    }
+    madvise(memory, size, MADV_SEQUENTIAL);
+    data = static_cast<const char *>(memory);
+    mapped = true;
+  }
+  ::close(fd);
+  return true;
+#else
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    return false;
+  }
+  size = file.tellg();
+  // uint64_t words keep the contents 8-byte aligned, like a mapping
+  buffer.assign((size + 7) / 8, 0);
+  file.seekg(0);
+  file.read(reinterpret_cast<char *>(buffer.data()), size);
+  data = reinterpret_cast<const char *>(buffer.data());
+  return static_cast<bool>(file);
+#endif
+}
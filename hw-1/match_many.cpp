@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <vector>
+
+#include "re2dfa.hpp"
+
+namespace {
+
+constexpr size_t LANES = 8;
+// Inputs are queued ORDER_BLOCK at a time, ordered by length, with those of
+// LONG_INPUT bytes or more last
+constexpr size_t ORDER_BLOCK = 256;
+constexpr size_t LONG_INPUT = 64;
+// Lanes with fewer bytes left than this at the end of a round run them there
+constexpr size_t RESYNC_INPUT = 8;
+
+// Inputs are handed to lanes from a queue. A round steps every lane as many
+// bytes as the lane closest to its end has left, in lockstep and with no
+// per-byte checks, as the dead state is absorbing. Lanes whose input ended
+// or died are then retired and refilled with selects rather than branches,
+// which would mispredict on inputs of mixed lengths. As the queue is
+// ordered by length, lanes mostly end their inputs in the same round, so
+// even short inputs get rounds of their whole length.
+struct Lanes {
+  const MatcherView &view;
+  const std::string_view *inputs;
+  size_t count;
+  uint64_t *res;
+  // Indices of inputs queued for lanes are queue[head, tail). Inputs from
+  // ordered on are not queued yet.
+  size_t queue[ORDER_BLOCK + LANES];
+  size_t head = 0;
+  size_t tail = 0;
+  size_t ordered = 0;
+  uint32_t states[LANES];
+  const unsigned char *next[LANES];
+  size_t left[LANES];
+  size_t input[LANES];
+
+  Lanes(const MatcherView &view, const std::string_view *inputs, size_t count,
+        uint64_t *res)
+      : view(view), inputs(inputs), count(count), res(res) {}
+
+  // Queues the next block of inputs behind the ones still queued, and asks
+  // for the bytes of the block after it, which the lanes read out of order
+  void orderBlock() {
+    std::copy(queue + head, queue + tail, queue);
+    tail -= head;
+    head = 0;
+    size_t end = std::min(ordered + ORDER_BLOCK, count);
+    size_t starts[LONG_INPUT + 1] = {};
+    for (size_t i = ordered; i < end; ++i) {
+      ++starts[std::min(inputs[i].size(), LONG_INPUT)];
+      if (i + ORDER_BLOCK < count) {
+        __builtin_prefetch(inputs[i + ORDER_BLOCK].data());
+      }
+    }
+    size_t start = tail;
+    for (size_t &bucket : starts) {
+      start += bucket;
+      bucket = start - bucket;
+    }
+    for (size_t i = ordered; i < end; ++i) {
+      queue[starts[std::min(inputs[i].size(), LONG_INPUT)]++] = i;
+    }
+    tail += end - ordered;
+    ordered = end;
+  }
+
+  // True if enough inputs are queued to refill every lane
+  bool fillQueue() {
+    if (tail - head < LANES && ordered < count) {
+      if (ordered == 0) {
+        for (size_t i = 0; i < std::min(ORDER_BLOCK, count); ++i) {
+          __builtin_prefetch(inputs[i].data());
+        }
+      }
+      orderBlock();
+    }
+    return tail - head >= LANES;
+  }
+
+  // Fills every lane, unless there are fewer inputs than lanes
+  bool start() {
+    if (!fillQueue()) {
+      return false;
+    }
+    for (size_t l = 0; l < LANES; ++l) {
+      refill(l, true);
+    }
+    return true;
+  }
+
+  size_t roundSteps() const {
+    size_t steps = left[0];
+    for (size_t l = 1; l < LANES; ++l) {
+      steps = std::min(steps, left[l]);
+    }
+    return steps;
+  }
+
+  // Moves the lanes steps bytes on and refills the ones that are done.
+  // Returns false, with nothing refilled, once too few inputs may be left
+  // to refill every lane.
+  bool endRound(size_t steps) {
+    for (size_t l = 0; l < LANES; ++l) {
+      next[l] += steps;
+      left[l] -= steps;
+    }
+    if (!fillQueue()) {
+      return false;
+    }
+    for (size_t l = 0; l < LANES; ++l) {
+      // A few bytes left are run here, so lanes that were handed inputs of
+      // about the same length start their next inputs in step again
+      if (left[l] < RESYNC_INPUT) {
+        states[l] = run(states[l], next[l], left[l]);
+        left[l] = 0;
+      }
+      bool done = left[l] == 0 || states[l] == 0;
+      res[input[l] / 64] |= uint64_t(done && view.isFinal(states[l]))
+                            << (input[l] % 64);
+      refill(l, done);
+    }
+    return true;
+  }
+
+  void refill(size_t l, bool done) {
+    size_t fresh = queue[head];
+    const std::string_view &s = inputs[fresh];
+    input[l] = done ? fresh : input[l];
+    states[l] = done ? view.start : states[l];
+    next[l] = done ? reinterpret_cast<const unsigned char *>(s.data())
+                   : next[l];
+    left[l] = done ? s.size() : left[l];
+    head += done;
+  }
+
+  // Runs what is left in the lanes and the inputs no lane took to the end
+  void finish(bool started) {
+    for (size_t l = 0; started && l < LANES; ++l) {
+      settle(input[l], run(states[l], next[l], left[l]));
+    }
+    for (; head < tail; ++head) {
+      settle(queue[head], view.run(inputs[queue[head]]));
+    }
+    for (; ordered < count; ++ordered) {
+      settle(ordered, view.run(inputs[ordered]));
+    }
+  }
+
+  uint32_t run(uint32_t state, const unsigned char *next, size_t left) {
+    for (size_t i = 0; i < left && state != 0; ++i) {
+      state = view.step(state, next[i]);
+    }
+    return state;
+  }
+
+  void settle(size_t input, uint32_t state) {
+    if (view.isFinal(state)) {
+      res[input / 64] |= uint64_t(1) << (input % 64);
+    }
+  }
+};
+
+void matchLanes(Lanes &lanes) {
+  const uint32_t *table = lanes.view.table;
+  const uint8_t *columnOf = lanes.view.columnOf;
+  bool started = lanes.start();
+  while (started) {
+    size_t steps = lanes.roundSteps();
+    // The states stay in registers for the whole round
+    uint32_t s0 = lanes.states[0], s1 = lanes.states[1];
+    uint32_t s2 = lanes.states[2], s3 = lanes.states[3];
+    uint32_t s4 = lanes.states[4], s5 = lanes.states[5];
+    uint32_t s6 = lanes.states[6], s7 = lanes.states[7];
+    const unsigned char *const *next = lanes.next;
+    for (size_t i = 0; i < steps; ++i) {
+      s0 = table[s0 + columnOf[next[0][i]]];
+      s1 = table[s1 + columnOf[next[1][i]]];
+      s2 = table[s2 + columnOf[next[2][i]]];
+      s3 = table[s3 + columnOf[next[3][i]]];
+      s4 = table[s4 + columnOf[next[4][i]]];
+      s5 = table[s5 + columnOf[next[5][i]]];
+      s6 = table[s6 + columnOf[next[6][i]]];
+      s7 = table[s7 + columnOf[next[7][i]]];
+    }
+    lanes.states[0] = s0, lanes.states[1] = s1;
+    lanes.states[2] = s2, lanes.states[3] = s3;
+    lanes.states[4] = s4, lanes.states[5] = s5;
+    lanes.states[6] = s6, lanes.states[7] = s7;
+    if (!lanes.endRound(steps)) {
+      break;
+    }
+  }
+  lanes.finish(started);
+}
+
+} // namespace
+
+void MatcherView::matchMany(const std::string_view *inputs, size_t count,
+                            std::vector<uint64_t> &res) const {
+  res.assign((count + 63) / 64, 0);
+  Lanes lanes(*this, inputs, count, res.data());
+  matchLanes(lanes);
+}
@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "re2dfa.hpp"
+
+Matcher::Matcher(const CompactDFA &dfa) {
+  // A DFA cut short by a limit has no start state to map to row 1
+  if (dfa.stateCount == 0) {
+    throw std::invalid_argument("Matcher: the DFA has no states");
+  }
+  columns = dfa.columns() + 1;
+  columnStorage.fill(0);
+  for (unsigned char c : dfa.alphabet) {
+    columnStorage[c] = dfa.columnOf[c] + 1;
+  }
+
+  // State s of dfa becomes row s + 1
+  rows = dfa.stateCount + 1;
+  tableStorage.assign(rows * columns, 0);
+  acceptStorage.assign((rows * columns + 63) / 64, 0);
+  start = columns;
+  for (uint32_t state = 0; state < dfa.stateCount; ++state) {
+    uint32_t row = (state + 1) * columns;
+    for (size_t column = 0; column < dfa.columns(); ++column) {
+      uint32_t to = dfa.next(state, column);
+      if (to != DEAD_STATE) {
+        tableStorage[row + column + 1] = (to + 1) * columns;
+      }
+    }
+    if (dfa.isFinal(state)) {
+      PositionSet::insert(acceptStorage.data(), row);
+    }
+  }
+  bind();
+}
+
+CompactDFA MatcherView::toCompactDFA() const {
+  std::string alphabet{};
+  std::array<uint8_t, 256> columnOfSymbol{};
+  columnOfSymbol.fill(NO_COLUMN);
+  for (int c = 0; c < 256; ++c) {
+    if (columnOf[c] != 0) {
+      alphabet += static_cast<char>(c);
+      columnOfSymbol[c] = columnOf[c] - 1;
+    }
+  }
+
+  CompactDFA res(alphabet, columnOfSymbol, columns - 1);
+  for (size_t row = 1; row < rows; ++row) {
+    res.addState();
+  }
+  // The initial state must become state 0, so swap it with row 1
+  auto stateOf = [this](uint32_t offset) {
+    uint32_t row = offset / columns;
+    if (row == start / columns) {
+      return 0u;
+    }
+    return row == 1 ? start / static_cast<uint32_t>(columns) - 1 : row - 1;
+  };
+  for (size_t row = 1; row < rows; ++row) {
+    uint32_t state = stateOf(row * columns);
+    for (size_t column = 1; column < columns; ++column) {
+      uint32_t to = table[row * columns + column];
+      if (to != 0) {
+        res.setTransition(state, column - 1, stateOf(to));
+      }
+    }
+    if (isFinal(row * columns)) {
+      res.makeFinal(state);
+    }
+  }
+  return res;
+}
+
+MultiMatcher::MultiMatcher(const CompactDFA &dfa)
+    : matcher(dfa), patternCount(dfa.patternCount),
+      patternWords(std::max<size_t>(dfa.patternWords, 1)),
+      patterns(matcher.rows * patternWords, 0) {
+  // A single pattern has no tags; its accepting states accept pattern 0
+  for (uint32_t state = 0; state < dfa.stateCount; ++state) {
+    uint64_t *row = &patterns[(state + 1) * patternWords];
+    if (dfa.patternWords > 0) {
+      std::copy(dfa.patternsOf(state), dfa.patternsOf(state) + patternWords,
+                row);
+    } else if (dfa.isFinal(state)) {
+      PositionSet::insert(row, 0);
+    }
+  }
+}
+
+std::ptrdiff_t MultiMatcher::firstMatch(std::string_view input) const {
+  const uint64_t *ids = match(input);
+  for (size_t i = 0; i < patternWords; ++i) {
+    if (ids[i] != 0) {
+      return i * 64 + __builtin_ctzll(ids[i]);
+    }
+  }
+  return -1;
+}
+
+void MultiMatcher::matchPrefixes(std::string_view input,
+                                 std::vector<uint64_t> &res) const {
+  res.resize(patternWords, 0);
+  uint32_t state = matcher.start;
+  PositionSet::unite(res.data(), patternsOf(state), patternWords);
+  for (char c : input) {
+    state = matcher.step(state, c);
+    if (state == 0) {
+      return;
+    }
+    PositionSet::unite(res.data(), patternsOf(state), patternWords);
+  }
+}
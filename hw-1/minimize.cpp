@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <queue>
+#include <vector>
+
+#include "re2dfa.hpp"
+
+// Hopcroft's partition refinement. The automaton is completed with an
+// explicit sink state, states are kept in one array grouped by block, and
+// every splitter is checked against precomputed inverse transitions, which
+// gives O(n * |alphabet| * log n) overall.
+CompactDFA minimize(const CompactDFA &dfa) {
+  const size_t columns = dfa.columns();
+  const uint32_t sink = dfa.stateCount;
+  const uint32_t n = dfa.stateCount + 1;
+
+  auto target = [&dfa, sink](uint32_t state, size_t column) {
+    if (state == sink) {
+      return sink;
+    }
+    uint32_t to = dfa.next(state, column);
+    return to == DEAD_STATE ? sink : to;
+  };
+
+  // Sources of the transitions into state t by column c are
+  // inverse[inverseStart[c * (n + 1) + t] .. inverseStart[c * (n + 1) + t + 1])
+  std::vector<uint32_t> inverseStart(columns * (n + 1) + 1, 0);
+  std::vector<uint32_t> inverse(columns * n);
+  for (size_t column = 0; column < columns; ++column) {
+    for (uint32_t state = 0; state < n; ++state) {
+      ++inverseStart[column * (n + 1) + target(state, column) + 1];
+    }
+  }
+  for (size_t i = 1; i < inverseStart.size(); ++i) {
+    inverseStart[i] += inverseStart[i - 1];
+  }
+  {
+    std::vector<uint32_t> fill(inverseStart.begin(), inverseStart.end() - 1);
+    for (size_t column = 0; column < columns; ++column) {
+      for (uint32_t state = 0; state < n; ++state) {
+        inverse[fill[column * (n + 1) + target(state, column)]++] = state;
+      }
+    }
+  }
+
+  // elements holds the states grouped by block, block b occupying
+  // [blockStart[b], blockEnd[b]); location is the inverse of elements.
+  // States of a block hit by the current splitter are moved to its front.
+  std::vector<uint32_t> elements(n);
+  std::vector<uint32_t> location(n);
+  std::vector<uint32_t> blockOf(n);
+  std::vector<uint32_t> blockStart{};
+  std::vector<uint32_t> blockEnd{};
+  std::vector<uint32_t> markedCount{};
+  std::vector<bool> inWorklist{};
+
+  {
+    // Accepting states come first, grouped by the patterns they accept, so
+    // states that accept different patterns are never merged
+    auto before = [&dfa, sink](uint32_t a, uint32_t b) {
+      bool finalA = a != sink && dfa.isFinal(a);
+      bool finalB = b != sink && dfa.isFinal(b);
+      if (finalA != finalB || !finalA) {
+        return finalA && !finalB;
+      }
+      return std::lexicographical_compare(
+          dfa.patternsOf(a), dfa.patternsOf(a) + dfa.patternWords,
+          dfa.patternsOf(b), dfa.patternsOf(b) + dfa.patternWords);
+    };
+    for (uint32_t state = 0; state < n; ++state) {
+      elements[state] = state;
+    }
+    std::stable_sort(elements.begin(), elements.end(), before);
+    for (uint32_t i = 0; i < n; ++i) {
+      location[elements[i]] = i;
+    }
+    auto addBlock = [&](uint32_t start, uint32_t end) {
+      for (uint32_t i = start; i < end; ++i) {
+        blockOf[elements[i]] = blockStart.size();
+      }
+      blockStart.push_back(start);
+      blockEnd.push_back(end);
+      markedCount.push_back(0);
+      inWorklist.push_back(false);
+    };
+    uint32_t start = 0;
+    for (uint32_t i = 1; i <= n; ++i) {
+      if (i == n || before(elements[start], elements[i])) {
+        addBlock(start, i);
+        start = i;
+      }
+    }
+  }
+
+  std::queue<uint32_t> worklist{};
+  // With a single splitter of all symbols it is enough to start from every
+  // initial block but the largest one.
+  uint32_t largest = 0;
+  for (uint32_t b = 1; b < blockStart.size(); ++b) {
+    if (blockEnd[b] - blockStart[b] > blockEnd[largest] - blockStart[largest]) {
+      largest = b;
+    }
+  }
+  for (uint32_t b = 0; b < blockStart.size(); ++b) {
+    if (b != largest) {
+      worklist.push(b);
+      inWorklist[b] = true;
+    }
+  }
+
+  std::vector<uint32_t> splitter{};
+  std::vector<uint32_t> touched{};
+
+  while (!worklist.empty()) {
+    uint32_t block = worklist.front();
+    worklist.pop();
+    inWorklist[block] = false;
+    splitter.assign(elements.begin() + blockStart[block],
+                    elements.begin() + blockEnd[block]);
+
+    for (size_t column = 0; column < columns; ++column) {
+      // Move every predecessor of the splitter to the front of its block
+      for (uint32_t to : splitter) {
+        size_t slot = column * (n + 1) + to;
+        for (uint32_t i = inverseStart[slot]; i < inverseStart[slot + 1];
+             ++i) {
+          uint32_t state = inverse[i];
+          uint32_t b = blockOf[state];
+          if (markedCount[b] == 0) {
+            touched.push_back(b);
+          }
+          uint32_t swapIndex = blockStart[b] + markedCount[b];
+          if (location[state] < swapIndex) {
+            continue; // already marked
+          }
+          uint32_t other = elements[swapIndex];
+          std::swap(elements[location[state]], elements[swapIndex]);
+          location[other] = location[state];
+          location[state] = swapIndex;
+          ++markedCount[b];
+        }
+      }
+
+      // Split every block that was hit only partially
+      for (uint32_t b : touched) {
+        uint32_t marked = markedCount[b];
+        markedCount[b] = 0;
+        if (marked == blockEnd[b] - blockStart[b]) {
+          continue;
+        }
+        uint32_t created = blockStart.size();
+        blockStart.push_back(blockStart[b]);
+        blockEnd.push_back(blockStart[b] + marked);
+        markedCount.push_back(0);
+        inWorklist.push_back(false);
+        blockStart[b] += marked;
+        for (uint32_t i = blockStart[created]; i < blockEnd[created]; ++i) {
+          blockOf[elements[i]] = created;
+        }
+
+        uint32_t push = created;
+        uint32_t rest = blockEnd[b] - blockStart[b];
+        if (!inWorklist[b] && rest < marked) {
+          push = b;
+        }
+        inWorklist[push] = true;
+        worklist.push(push);
+      }
+      touched.clear();
+    }
+  }
+
+  // Number the surviving blocks in BFS order from the initial state so the
+  // result is deterministic. The sink's block is dropped entirely: its states
+  // can never reach an accepting state.
+  const uint32_t sinkBlock = blockOf[sink];
+  std::vector<uint32_t> blockId(blockStart.size(), DEAD_STATE);
+  std::vector<uint32_t> order{};
+  CompactDFA res(dfa.alphabet, dfa.columnOf, dfa.columns());
+  res.setPatternCount(dfa.patternCount);
+  if (dfa.stateCount == 0 || blockOf[0] == sinkBlock) {
+    res.addState();
+    return res;
+  }
+  blockId[blockOf[0]] = 0;
+  order.push_back(blockOf[0]);
+  res.addState();
+  for (size_t i = 0; i < order.size(); ++i) {
+    uint32_t representative = elements[blockStart[order[i]]];
+    if (dfa.isFinal(representative)) {
+      res.makeFinal(i);
+      std::copy(dfa.patternsOf(representative),
+                dfa.patternsOf(representative) + dfa.patternWords,
+                res.patternsOf(i));
+    }
+    for (size_t column = 0; column < columns; ++column) {
+      uint32_t toBlock = blockOf[target(representative, column)];
+      if (toBlock == sinkBlock) {
+        continue;
+      }
+      if (blockId[toBlock] == DEAD_STATE) {
+        blockId[toBlock] = order.size();
+        order.push_back(toBlock);
+        res.addState();
+      }
+      res.setTransition(i, column, blockId[toBlock]);
+    }
+  }
+
+  return res;
+}
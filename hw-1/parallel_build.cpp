@@ -0,0 +1,267 @@
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "re2dfa.hpp"
+
+namespace {
+
+// The set of a state lives only in the key of its ConcurrentStateMap entry,
+// which stays put until the map is destroyed
+struct WorkItem {
+  uint32_t id;
+  const PositionSet *set;
+};
+
+// Per-thread frontier. The owner pushes and pops at the back, thieves take
+// the oldest items from the front.
+struct WorkQueue {
+  std::mutex mutex{};
+  std::deque<WorkItem> items{};
+
+  void push(WorkItem item) {
+    std::lock_guard<std::mutex> lock(mutex);
+    items.push_back(item);
+  }
+
+  bool pop(WorkItem &item) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (items.empty()) {
+      return false;
+    }
+    item = items.back();
+    items.pop_back();
+    return true;
+  }
+
+  bool steal(WorkItem &item) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (items.empty()) {
+      return false;
+    }
+    item = items.front();
+    items.pop_front();
+    return true;
+  }
+};
+
+// Set-to-id map split into independently locked shards
+struct ConcurrentStateMap {
+  static constexpr size_t SHARDS = 64;
+
+  using IdMap = std::unordered_map<
+      PositionSet, uint32_t, PositionSetHash, std::equal_to<PositionSet>,
+      TrackingAllocator<std::pair<const PositionSet, uint32_t>>>;
+
+  struct Shard {
+    std::mutex mutex{};
+    IdMap ids{};
+  };
+
+  std::array<Shard, SHARDS> shards{};
+  std::atomic<uint32_t> nextId{0};
+
+  ConcurrentStateMap(CompileBudget *budget) {
+    for (Shard &shard : shards) {
+      shard.ids = IdMap(0, PositionSetHash{}, std::equal_to<PositionSet>{},
+                        budget);
+    }
+  }
+
+  // Returns the id of set, the copy of set held by the map, and whether
+  // this call created it
+  std::pair<uint32_t, const PositionSet *> findOrAdd(const PositionSet &set,
+                                                     bool &added) {
+    Shard &shard = shards[set.hash() % SHARDS];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto found = shard.ids.find(set);
+    added = found == shard.ids.end();
+    if (added) {
+      found = shard.ids.emplace(set, nextId++).first;
+    }
+    return {found->second, &found->first};
+  }
+};
+
+struct BuiltState {
+  uint32_t id;
+  const PositionSet *set;
+  std::vector<uint32_t, TrackingAllocator<uint32_t>> row;
+};
+
+} // namespace
+
+CompactDFA buildParallel(const PositionAutomaton &automaton, size_t threads,
+                         CompileStats *stats, bool named,
+                         CompileBudget *budget) {
+  const size_t columns = automaton.columns();
+  threads = std::max<size_t>(threads, 1);
+
+  ConcurrentStateMap stateIds(budget);
+  std::vector<WorkQueue> queues(threads);
+  std::vector<std::vector<BuiltState, TrackingAllocator<BuiltState>>> built(
+      threads, std::vector<BuiltState, TrackingAllocator<BuiltState>>(budget));
+  // Counters are kept per thread and summed once all threads are done
+  std::vector<CompileStats> threadStats(threads);
+  // Number of discovered states that are not fully processed yet. A state
+  // is counted before its parent is uncounted, so zero means done.
+  std::atomic<size_t> pending{1};
+  // Items in all queues, counted after they are pushed and before they are
+  // popped. Workers that find nothing to steal sleep on wake until there
+  // is something, everything is done or a limit is passed.
+  std::atomic<size_t> queued{1};
+  std::atomic<bool> stopped{false};
+  std::atomic<size_t> sleeping{0};
+  std::mutex idle{};
+  std::condition_variable wake{};
+  auto wakeUp = [&](bool all) {
+    if (sleeping.load() == 0) {
+      return;
+    }
+    // Taking the lock orders this with a sleeper's last look at the counters
+    { std::lock_guard<std::mutex> lock(idle); }
+    if (all) {
+      wake.notify_all();
+    } else {
+      wake.notify_one();
+    }
+  };
+
+  // Sets and rows are charged to budget; every thread checks it before it
+  // expands a state and all of them stop once a limit is passed
+  PositionSet initial(automaton.positionCount, budget);
+  initial.unite(automaton.initial.data());
+  bool created = false;
+  queues[0].push(WorkItem{0, stateIds.findOrAdd(initial, created).second});
+
+  auto worker = [&](size_t self) {
+    CompileStats counters{};
+    PositionSet S(automaton.positionCount, budget);
+    WorkItem item{};
+    bool added = false;
+    while (true) {
+      bool found = queues[self].pop(item);
+      for (size_t i = 1; !found && i < threads; ++i) {
+        found = queues[(self + i) % threads].steal(item);
+      }
+      if (!found) {
+        std::unique_lock<std::mutex> lock(idle);
+        ++sleeping;
+        wake.wait(lock, [&]() {
+          return queued.load() > 0 || pending.load() == 0 || stopped.load();
+        });
+        --sleeping;
+        if (pending.load() == 0 || stopped.load()) {
+          threadStats[self] = counters;
+          return;
+        }
+        continue;
+      }
+      --queued;
+      if (budget != nullptr && !budget->check(stateIds.nextId.load())) {
+        stopped = true;
+        wakeUp(true);
+        threadStats[self] = counters;
+        return;
+      }
+
+      std::vector<uint32_t, TrackingAllocator<uint32_t>> row(
+          columns, DEAD_STATE, budget);
+      for (size_t column = 0; column < columns; ++column) {
+        automaton.step(item.set->words.data(), column, S.words.data());
+        if (S.empty()) {
+          continue;
+        }
+        auto to = stateIds.findOrAdd(S, added);
+        ++counters.lookups;
+        ++counters.transitions;
+        if (added) {
+          ++pending;
+          counters.addSet(S.count());
+          queues[self].push(WorkItem{to.first, to.second});
+          ++queued;
+          wakeUp(false);
+        } else {
+          ++counters.duplicateHits;
+        }
+        row[column] = to.first;
+      }
+      built[self].push_back(BuiltState{item.id, item.set, std::move(row)});
+      if (--pending == 0) {
+        wakeUp(true);
+      }
+    }
+  };
+
+  std::vector<std::thread> workers{};
+  for (size_t t = 1; t < threads; ++t) {
+    workers.emplace_back(worker, t);
+  }
+  worker(0);
+  for (auto &thread : workers) {
+    thread.join();
+  }
+
+  if (stats != nullptr) {
+    stats->lookups = 0;
+    stats->duplicateHits = 0;
+    stats->transitions = 0;
+    stats->totalSetSize = 0;
+    stats->maxSetSize = 0;
+    stats->addSet(initial.count());
+    for (const CompileStats &counters : threadStats) {
+      stats->lookups += counters.lookups;
+      stats->duplicateHits += counters.duplicateHits;
+      stats->transitions += counters.transitions;
+      stats->totalSetSize += counters.totalSetSize;
+      stats->maxSetSize = std::max(stats->maxSetSize, counters.maxSetSize);
+    }
+    stats->states = stateIds.nextId.load();
+  }
+
+  if (budget != nullptr && budget->status != CompileStatus::OK) {
+    return CompactDFA(automaton.alphabet, automaton.columnOf, columns);
+  }
+
+  // Ids were handed out in whatever order threads got to the states.
+  // Renumber them breadth-first in column order, which is exactly the
+  // order of the sequential FIFO construction.
+  std::vector<const BuiltState *> byId(stateIds.nextId.load(), nullptr);
+  for (const auto &states : built) {
+    for (const auto &state : states) {
+      byId[state.id] = &state;
+    }
+  }
+
+  CompactDFA res(automaton.alphabet, automaton.columnOf, columns);
+  res.setPatternCount(automaton.endPositions.size());
+  std::vector<uint32_t> renumbered(byId.size(), DEAD_STATE);
+  std::vector<uint32_t> order{0};
+  renumbered[0] = 0;
+  res.addState();
+  for (size_t i = 0; i < order.size(); ++i) {
+    const BuiltState &state = *byId[order[i]];
+    for (size_t column = 0; column < columns; ++column) {
+      uint32_t to = state.row[column];
+      if (to == DEAD_STATE) {
+        continue;
+      }
+      if (renumbered[to] == DEAD_STATE) {
+        renumbered[to] = order.size();
+        order.push_back(to);
+        res.addState();
+      }
+      res.setTransition(i, column, renumbered[to]);
+    }
+    res.markAccepting(i, state.set->words.data(), automaton.endPositions);
+    if (named) {
+      res.names.push_back(getPosReadable(*state.set));
+    }
+  }
+
+  return res;
+}
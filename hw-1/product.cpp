@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "re2dfa.hpp"
+
+namespace {
+
+constexpr uint64_t PRUNED = UINT64_MAX;
+
+// One byte for each combination of columns of a and b that the bytes of
+// their alphabets fall into. Bytes of one combination lead every pair of
+// states to the same pair, so the smallest of them stands for all.
+std::string productSymbols(const LazyDFA &a, const LazyDFA *b) {
+  std::map<std::pair<uint8_t, uint8_t>, char> columns{};
+  for (const std::string &alphabet :
+       {a.automaton.alphabet, b == nullptr ? "" : b->automaton.alphabet}) {
+    for (unsigned char c : alphabet) {
+      uint8_t other = b == nullptr ? NO_COLUMN : b->automaton.columnOf[c];
+      columns.emplace(std::make_pair(a.automaton.columnOf[c], other), c);
+    }
+  }
+  std::string res{};
+  for (const auto &column : columns) {
+    res += column.second;
+  }
+  std::sort(res.begin(), res.end());
+  return res;
+}
+
+// Breadth-first search from state 0 over states numbered by 64-bit keys.
+// step(key, c, to) sets to the key reached by c, or PRUNED if no accepting
+// state can be reached from there, and returns false if a cache was flushed.
+template <typename Step, typename Accepts>
+WordSearch searchWord(const std::string &symbols, Step step,
+                      Accepts accepts) {
+  WordSearch res{};
+  // Reached states in breadth-first order with the state and symbol that
+  // first led to each, from which the witness is read backwards
+  std::vector<uint64_t> keys{0};
+  std::vector<std::pair<uint32_t, char>> parents{{0, '\0'}};
+  std::unordered_map<uint64_t, uint32_t> seen{{0, 0}};
+  for (uint32_t i = 0; i < keys.size(); ++i) {
+    if (accepts(keys[i])) {
+      res.found = true;
+      for (uint32_t j = i; j != 0; j = parents[j].first) {
+        res.witness += parents[j].second;
+      }
+      std::reverse(res.witness.begin(), res.witness.end());
+      break;
+    }
+    for (char c : symbols) {
+      uint64_t to = PRUNED;
+      if (!step(keys[i], c, to)) {
+        res.status = CompileStatus::MEMORY_LIMIT;
+        res.pairs = keys.size();
+        return res;
+      }
+      if (to != PRUNED && seen.emplace(to, keys.size()).second) {
+        keys.push_back(to);
+        parents.emplace_back(i, c);
+      }
+    }
+  }
+  res.pairs = keys.size();
+  return res;
+}
+
+} // namespace
+
+WordSearch findWord(LazyDFA &dfa) {
+  return searchWord(
+      productSymbols(dfa, nullptr),
+      [&dfa](uint64_t state, char c, uint64_t &to) {
+        size_t flushes = dfa.flushes;
+        uint32_t next = dfa.next(state, c);
+        to = next == DEAD_STATE ? PRUNED : next;
+        return dfa.flushes == flushes;
+      },
+      [&dfa](uint64_t state) { return dfa.isFinal(state); });
+}
+
+WordSearch findWord(LazyDFA &a, LazyDFA &b, ProductOperation operation) {
+  // A pair is the state of a in the high half of its key and that of b in
+  // the low half; either may be DEAD_STATE
+  auto isFinal = [](LazyDFA &dfa, uint32_t state) {
+    return state != DEAD_STATE && dfa.isFinal(state);
+  };
+  return searchWord(
+      productSymbols(a, &b),
+      [&a, &b, operation](uint64_t pair, char c, uint64_t &to) {
+        size_t flushes = a.flushes + b.flushes;
+        uint32_t first = pair >> 32;
+        uint32_t second = pair & UINT32_MAX;
+        first = first == DEAD_STATE ? DEAD_STATE : a.next(first, c);
+        second = second == DEAD_STATE ? DEAD_STATE : b.next(second, c);
+        bool pruned = (first == DEAD_STATE && second == DEAD_STATE) ||
+                      (first == DEAD_STATE &&
+                       operation != ProductOperation::SYMMETRIC_DIFFERENCE) ||
+                      (second == DEAD_STATE &&
+                       operation == ProductOperation::INTERSECTION);
+        to = pruned ? PRUNED : static_cast<uint64_t>(first) << 32 | second;
+        return a.flushes + b.flushes == flushes;
+      },
+      [&a, &b, operation, &isFinal](uint64_t pair) {
+        bool first = isFinal(a, pair >> 32);
+        bool second = isFinal(b, pair & UINT32_MAX);
+        switch (operation) {
+        case ProductOperation::INTERSECTION:
+          return first && second;
+        case ProductOperation::DIFFERENCE:
+          return first && !second;
+        default:
+          return first != second;
+        }
+      });
+}
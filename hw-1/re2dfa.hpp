@@ -0,0 +1,1431 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "api.hpp"
+
+// Trace output of the construction, compiled in only with DEBUG. Without it
+// the message expression is not even evaluated. Traces go to stderr, so they
+// never mix with automata or batch records written to stdout.
+#ifdef DEBUG
+#include <iostream>
+#define RE2DFA_TRACE(message) (std::cerr << message << std::endl)
+#else
+#define RE2DFA_TRACE(message) ((void)0)
+#endif
+
+constexpr char SYMBOL_OR = '|';
+constexpr char SYMBOL_CONCAT = '.';
+constexpr char SYMBOL_REPEAT = '*';
+constexpr char SYMBOL_LPAREN = '(';
+constexpr char SYMBOL_RPAREN = ')';
+constexpr char SYMBOL_EMPTY = '{';
+constexpr char SYMBOL_NUMBER_SIGN = '#';
+constexpr char SYMBOL_HELPER_POSITION = '?';
+constexpr char SYMBOL_ROOT = '@';
+
+enum class CompileStatus : uint8_t {
+  OK,
+  STATE_LIMIT,
+  MEMORY_LIMIT,
+  TIME_LIMIT,
+};
+
+// Limits of one compilation, 0 meaning none, and what it has used so far.
+// Every container that allocates through a TrackingAllocator bound to the
+// budget is charged for its memory, from any thread. Allocations never fail;
+// construction calls check() once per state instead and stops cleanly at
+// the first limit passed.
+struct CompileBudget {
+  size_t maxStates = 0;
+  size_t maxBytes = 0;
+  double maxMs = 0;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  std::atomic<size_t> usedBytes{0};
+  std::atomic<size_t> peakBytes{0};
+  std::atomic<CompileStatus> status{CompileStatus::OK};
+
+  void charge(size_t bytes) {
+    size_t used = usedBytes += bytes;
+    size_t peak = peakBytes.load(std::memory_order_relaxed);
+    while (used > peak && !peakBytes.compare_exchange_weak(peak, used)) {
+    }
+  }
+
+  void release(size_t bytes) { usedBytes -= bytes; }
+
+  bool limited() const { return maxStates != 0 || maxBytes != 0 || maxMs != 0; }
+
+  // Records the first limit passed once states states have been found and
+  // returns whether every limit still holds.
+  bool check(size_t states) {
+    CompileStatus passed = CompileStatus::OK;
+    if (maxStates != 0 && states > maxStates) {
+      passed = CompileStatus::STATE_LIMIT;
+    } else if (maxBytes != 0 && usedBytes.load() > maxBytes) {
+      passed = CompileStatus::MEMORY_LIMIT;
+    } else if (maxMs != 0 &&
+               std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - start)
+                       .count() > maxMs) {
+      passed = CompileStatus::TIME_LIMIT;
+    }
+    if (passed != CompileStatus::OK) {
+      CompileStatus expected = CompileStatus::OK;
+      status.compare_exchange_strong(expected, passed);
+    }
+    return status.load() == CompileStatus::OK;
+  }
+};
+
+// std::allocator that charges its CompileBudget, if it has one. The budget
+// follows containers on move and swap but not on copy assignment.
+template <typename T> struct TrackingAllocator {
+  using value_type = T;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  CompileBudget *budget = nullptr;
+
+  TrackingAllocator(CompileBudget *budget = nullptr) : budget(budget) {}
+
+  template <typename U>
+  TrackingAllocator(const TrackingAllocator<U> &other)
+      : budget(other.budget) {}
+
+  T *allocate(size_t n) {
+    if (budget != nullptr) {
+      budget->charge(n * sizeof(T));
+    }
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T *p, size_t n) {
+    if (budget != nullptr) {
+      budget->release(n * sizeof(T));
+    }
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  template <typename U>
+  bool operator==(const TrackingAllocator<U> &other) const {
+    return budget == other.budget;
+  }
+
+  template <typename U>
+  bool operator!=(const TrackingAllocator<U> &other) const {
+    return budget != other.budget;
+  }
+};
+
+// Dense set of positions, one bit per position number. All sets built for one
+// expression have the same number of words, so unions are word-wide ORs and
+// equality is a single memcmp. The static helpers work on raw words so that
+// sets living inside a NodeArena buffer share the same code. Sets created
+// with a budget charge it for their words, and so do their copies.
+struct PositionSet {
+  PositionSet(size_t size = 0, CompileBudget *budget = nullptr)
+      : words((size + 63) / 64, 0, TrackingAllocator<uint64_t>(budget)) {}
+
+  static void insert(uint64_t *words, size_t pos) {
+    words[pos / 64] |= uint64_t(1) << (pos % 64);
+  }
+
+  static bool contains(const uint64_t *words, size_t pos) {
+    return (words[pos / 64] >> (pos % 64)) & 1;
+  }
+
+  static void unite(uint64_t *words, const uint64_t *other, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      words[i] |= other[i];
+    }
+  }
+
+  // Ors other, size words long, shifted up by shift positions into words.
+  // Only words that receive a set bit are written, so words needs room for
+  // the highest shifted position alone.
+  static void uniteShifted(uint64_t *words, const uint64_t *other, size_t size,
+                           size_t shift) {
+    uint64_t *to = words + shift / 64;
+    size_t bits = shift % 64;
+    if (bits == 0) {
+      unite(to, other, size);
+      return;
+    }
+    for (size_t i = 0; i < size; ++i) {
+      to[i] |= other[i] << bits;
+      uint64_t high = other[i] >> (64 - bits);
+      if (high != 0) {
+        to[i + 1] |= high;
+      }
+    }
+  }
+
+  // Calls f(pos) for every position in the set in increasing order.
+  template <typename F>
+  static void forEach(const uint64_t *words, size_t size, F f) {
+    for (size_t i = 0; i < size; ++i) {
+      uint64_t word = words[i];
+      while (word) {
+        f(i * 64 + __builtin_ctzll(word));
+        word &= word - 1;
+      }
+    }
+  }
+
+  void insert(size_t pos) { insert(words.data(), pos); }
+
+  bool contains(size_t pos) const { return contains(words.data(), pos); }
+
+  void unite(const uint64_t *other) {
+    unite(words.data(), other, words.size());
+  }
+
+  void unite(const PositionSet &other) { unite(other.words.data()); }
+
+  static bool empty(const uint64_t *words, size_t size) {
+    return std::all_of(words, words + size,
+                       [](uint64_t word) { return word == 0; });
+  }
+
+  static size_t count(const uint64_t *words, size_t size) {
+    size_t res = 0;
+    for (size_t i = 0; i < size; ++i) {
+      res += __builtin_popcountll(words[i]);
+    }
+    return res;
+  }
+
+  bool empty() const { return empty(words.data(), words.size()); }
+
+  size_t count() const { return count(words.data(), words.size()); }
+
+  bool operator==(const PositionSet &other) const {
+    return words.size() == other.words.size() &&
+           std::memcmp(words.data(), other.words.data(),
+                       words.size() * sizeof(uint64_t)) == 0;
+  }
+
+  bool operator!=(const PositionSet &other) const { return !(*this == other); }
+
+  // FNV-1a over the words; the bitset is already a canonical form of the set
+  static size_t hash(const uint64_t *words, size_t size) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+      h = (h ^ words[i]) * 1099511628211ull;
+    }
+    return h ^ (h >> 32);
+  }
+
+  size_t hash() const { return hash(words.data(), words.size()); }
+
+  template <typename F> void forEach(F f) const {
+    forEach(words.data(), words.size(), f);
+  }
+
+  std::vector<uint64_t, TrackingAllocator<uint64_t>> words;
+};
+
+struct PositionSetHash {
+  size_t operator()(const PositionSet &set) const { return set.hash(); }
+};
+
+// Dotted one-based position numbers, the traditional state name
+inline std::string getPosReadable(const uint64_t *words, size_t size) {
+  std::string conditionName = "";
+  char buffer[24];
+  PositionSet::forEach(words, size, [&conditionName, &buffer](size_t pos) {
+    if (!conditionName.empty()) {
+      conditionName += '.';
+    }
+    auto res = std::to_chars(buffer, buffer + sizeof(buffer), pos + 1);
+    conditionName.append(buffer, res.ptr);
+  });
+  return conditionName;
+}
+
+inline std::string getPosReadable(const PositionSet &positions) {
+  return getPosReadable(positions.words.data(), positions.words.size());
+}
+
+enum class NodeType : uint8_t {
+  POSITION,
+  EMPTY,
+  OR,
+  CONCAT,
+  REPEAT,
+};
+
+constexpr int32_t NO_NODE = -1;
+
+// Plain AST node stored in a NodeArena. Children are arena indices and are
+// always added before their parent, so arena order is a post-order walk.
+// Positions are numbered in reading order, so the positions of a subtree are
+// exactly shape.span consecutive ones starting at base.
+struct Node {
+  NodeType type;
+  char symbol;
+  int32_t left;
+  int32_t right;
+  int32_t shape;
+  int32_t base;
+};
+
+// Analysis of a subtree with its symbols erased and its positions counted
+// from 0. It depends on nothing else, so every occurrence of the same shape
+// shares one record. firstpos and lastpos take setWords words each, starting
+// at words in NodeArena::shapeWords.
+struct Shape {
+  NodeType type;
+  bool nullable;
+  int32_t left;
+  int32_t right;
+  uint32_t span;
+  uint32_t setWords;
+  size_t words;
+};
+
+// Owns the whole syntax tree of one expression together with every position
+// set computed for it. Buffers are cleared, not freed, between expressions,
+// so once they have grown to the largest input compiling allocates nothing.
+// That includes the stacks of the Parser and the scratch of symbolClasses.
+struct NodeArena {
+
+  // words holds followpos of every position, wordsPerSet words each.
+  // Subtrees are hash-consed into shapes as they are added, looked up in the
+  // open-addressing table shapeTable; with shareShapes off every node gets a
+  // shape of its own.
+  std::vector<Node> nodes{};
+  std::vector<Shape> shapes{};
+  std::vector<int32_t> shapeTable{};
+  std::vector<uint64_t> shapeWords{};
+  std::vector<char> positionSymbols{};
+  std::array<std::vector<int32_t>, 256> symbolToPositions{};
+  std::vector<uint64_t> words{};
+  size_t wordsPerSet = 0;
+  size_t followposWords = 0;
+  bool shareShapes = true;
+
+  std::vector<int32_t> operands{};
+  std::vector<char> operators{};
+  std::vector<uint8_t> nodeClasses{};
+  std::array<std::vector<int32_t>, 256> classesOf{};
+
+  void reset(size_t positionCount) {
+    nodes.clear();
+    shapes.clear();
+    std::fill(shapeTable.begin(), shapeTable.end(), NO_NODE);
+    shapeWords.clear();
+    positionSymbols.clear();
+    for (auto &positions : symbolToPositions) {
+      positions.clear();
+    }
+    wordsPerSet = (positionCount + 63) / 64;
+    followposWords = positionCount * wordsPerSet;
+    words.assign(followposWords, 0);
+  }
+
+  int32_t add(NodeType type, char symbol, int32_t left = NO_NODE,
+              int32_t right = NO_NODE) {
+    int32_t base = positionSymbols.size();
+    if (type == NodeType::POSITION) {
+      positionSymbols.push_back(symbol);
+      symbolToPositions[static_cast<unsigned char>(symbol)].push_back(base);
+    } else if (left != NO_NODE) {
+      base = nodes[left].base;
+    }
+    int32_t shape = shapeOf(type, left == NO_NODE ? NO_NODE : nodes[left].shape,
+                            right == NO_NODE ? NO_NODE : nodes[right].shape);
+    nodes.push_back(Node{type, symbol, left, right, shape, base});
+    analyze(nodes.size() - 1);
+    return nodes.size() - 1;
+  }
+
+  size_t positionCount() const { return positionSymbols.size(); }
+
+  // Every symbol that owns a position, except the end marker, in byte order
+  std::string alphabet() const {
+    std::string res{};
+    for (int c = 0; c < 256; ++c) {
+      if (c != SYMBOL_NUMBER_SIGN && !symbolToPositions[c].empty()) {
+        res += static_cast<char>(c);
+      }
+    }
+    return res;
+  }
+
+  // Bytes taken by the tree and its analysis, followpos included
+  size_t analysisBytes() const {
+    return nodes.size() * sizeof(Node) + shapes.size() * sizeof(Shape) +
+           (shareShapes ? shapeTable.size() * sizeof(int32_t) : 0) +
+           (shapeWords.size() + words.size()) * sizeof(uint64_t);
+  }
+
+  uint64_t *followpos(size_t pos) { return &words[pos * wordsPerSet]; }
+
+  const uint64_t *followpos(size_t pos) const {
+    return &words[pos * wordsPerSet];
+  }
+
+  // Splits the alphabet into classes of symbols that the automaton of the
+  // arena treats alike, maps each symbol to its class in columnOf and
+  // returns the number of classes. Classes are numbered in the order of
+  // their smallest symbol; bytes outside the alphabet get NO_COLUMN.
+  size_t symbolClasses(std::array<uint8_t, 256> &columnOf);
+
+  bool nullable(int32_t node) const {
+    return shapes[nodes[node].shape].nullable;
+  }
+
+  // firstpos of node over all positions of the expression
+  PositionSet firstpos(int32_t node) const {
+    PositionSet res(wordsPerSet * 64);
+    const Shape &shape = shapes[nodes[node].shape];
+    PositionSet::uniteShifted(res.words.data(), shapeFirstpos(shape),
+                              shape.setWords, nodes[node].base);
+    return res;
+  }
+
+  const uint64_t *shapeFirstpos(const Shape &shape) const {
+    return shapeWords.data() + shape.words;
+  }
+
+  const uint64_t *shapeLastpos(const Shape &shape) const {
+    return shapeWords.data() + shape.words + shape.setWords;
+  }
+
+  // Id of the shape with the given type and child shapes, analyzed on first
+  // use: nullable, firstpos and lastpos relative to its first position.
+  int32_t shapeOf(NodeType type, int32_t left, int32_t right) {
+    size_t slot = 0;
+    if (shareShapes) {
+      if (2 * (shapes.size() + 1) > shapeTable.size()) {
+        growShapeTable();
+      }
+      for (slot = shapeSlot(type, left, right);; ++slot) {
+        slot &= shapeTable.size() - 1;
+        int32_t id = shapeTable[slot];
+        if (id == NO_NODE) {
+          break;
+        }
+        const Shape &found = shapes[id];
+        if (found.type == type && found.left == left && found.right == right) {
+          return id;
+        }
+      }
+    }
+
+    Shape shape{type, false, left, right, 0, 0, shapeWords.size()};
+    uint32_t leftSpan = left == NO_NODE ? 0 : shapes[left].span;
+    switch (type) {
+    case NodeType::POSITION:
+      shape.span = 1;
+      break;
+    case NodeType::EMPTY:
+      shape.nullable = true;
+      break;
+    case NodeType::OR:
+      shape.nullable = shapes[left].nullable || shapes[right].nullable;
+      shape.span = leftSpan + shapes[right].span;
+      break;
+    case NodeType::CONCAT:
+      shape.nullable = shapes[left].nullable && shapes[right].nullable;
+      shape.span = leftSpan + shapes[right].span;
+      break;
+    case NodeType::REPEAT:
+      shape.nullable = true;
+      shape.span = leftSpan;
+      break;
+    }
+    shape.setWords = (shape.span + 63) / 64;
+    shapeWords.resize(shapeWords.size() + 2 * shape.setWords, 0);
+
+    uint64_t *first = shapeWords.data() + shape.words;
+    uint64_t *last = first + shape.setWords;
+    auto addShifted = [this](uint64_t *to, const uint64_t *from,
+                             int32_t shapeId, size_t shift) {
+      PositionSet::uniteShifted(to, from, shapes[shapeId].setWords, shift);
+    };
+    switch (type) {
+    case NodeType::POSITION:
+      PositionSet::insert(first, 0);
+      PositionSet::insert(last, 0);
+      break;
+    case NodeType::EMPTY:
+      break;
+    case NodeType::OR:
+      addShifted(first, shapeFirstpos(shapes[left]), left, 0);
+      addShifted(first, shapeFirstpos(shapes[right]), right, leftSpan);
+      addShifted(last, shapeLastpos(shapes[left]), left, 0);
+      addShifted(last, shapeLastpos(shapes[right]), right, leftSpan);
+      break;
+    case NodeType::CONCAT:
+      addShifted(first, shapeFirstpos(shapes[left]), left, 0);
+      if (shapes[left].nullable) {
+        addShifted(first, shapeFirstpos(shapes[right]), right, leftSpan);
+      }
+      addShifted(last, shapeLastpos(shapes[right]), right, leftSpan);
+      if (shapes[right].nullable) {
+        addShifted(last, shapeLastpos(shapes[left]), left, 0);
+      }
+      break;
+    case NodeType::REPEAT:
+      addShifted(first, shapeFirstpos(shapes[left]), left, 0);
+      addShifted(last, shapeLastpos(shapes[left]), left, 0);
+      break;
+    }
+
+    shapes.push_back(shape);
+    if (shareShapes) {
+      shapeTable[slot] = shapes.size() - 1;
+    }
+    return shapes.size() - 1;
+  }
+
+  size_t shapeSlot(NodeType type, int32_t left, int32_t right) const {
+    uint64_t key = uint64_t(type) << 60 | uint64_t(left + 1) << 30 |
+                   uint64_t(right + 1);
+    key *= 0x9E3779B97F4A7C15ull;
+    return key ^ key >> 32;
+  }
+
+  // Doubles shapeTable and reinserts every shape
+  void growShapeTable() {
+    shapeTable.assign(std::max<size_t>(64, 2 * shapeTable.size()), NO_NODE);
+    for (size_t id = 0; id < shapes.size(); ++id) {
+      const Shape &shape = shapes[id];
+      size_t slot = shapeSlot(shape.type, shape.left, shape.right);
+      while (shapeTable[slot & (shapeTable.size() - 1)] != NO_NODE) {
+        ++slot;
+      }
+      shapeTable[slot & (shapeTable.size() - 1)] = id;
+    }
+  }
+
+  // Adds the contribution of node i to followpos. Its shape and those of its
+  // children are complete by then, so calling it from add analyzes the tree
+  // bottom-up while it is being built. Positions stay distinct per
+  // occurrence, so this is the only per-node work.
+  void analyze(int32_t i) {
+    const Node &node = nodes[i];
+    if (node.type != NodeType::CONCAT && node.type != NodeType::REPEAT) {
+      return;
+    }
+    const Node &left = nodes[node.left];
+    const Node &right =
+        node.type == NodeType::CONCAT ? nodes[node.right] : left;
+    const Shape &from = shapes[left.shape];
+    const Shape &to = shapes[right.shape];
+    const uint64_t *toFirst = shapeFirstpos(to);
+    PositionSet::forEach(shapeLastpos(from), from.setWords,
+                         [this, &left, &right, &to, toFirst](size_t pos) {
+                           PositionSet::uniteShifted(followpos(left.base + pos),
+                                                     toFirst, to.setWords,
+                                                     right.base);
+                         });
+  }
+};
+
+// Single-pass operator-precedence parser. It reads the expression one
+// character at a time with explicit operand and operator stacks and reduces
+// into the arena as soon as both operands of an operator are known, so every
+// node is analyzed the moment it is created and nesting depth never turns
+// into recursion depth. Concatenation is implicit, a missing operand is the
+// empty word and the end marker is appended after the whole expression.
+// Several patterns can share one arena when the caller resets it for all of
+// them up front; each is then parsed with its own end marker. The stacks
+// belong to the arena, so they stay warm from one expression to the next.
+struct Parser {
+
+  std::string_view input;
+  NodeArena &arena;
+  std::vector<int32_t> &operands;
+  std::vector<char> &operators;
+
+  Parser(std::string_view input, NodeArena &arena, bool resetArena = true)
+      : input(input), arena(arena), operands(arena.operands),
+        operators(arena.operators) {
+    if (resetArena) {
+      arena.reset(positionCount(input));
+    }
+    operands.clear();
+    operators.clear();
+  }
+
+  // Positions of input, its end marker included
+  static size_t positionCount(std::string_view input) {
+    return std::count_if(input.begin(), input.end(), isSymbol) + 1;
+  }
+
+  static bool isSymbol(char c) {
+    return std::isalnum(static_cast<unsigned char>(c));
+  }
+
+  static int precedence(char op) { return op == SYMBOL_OR ? 1 : 2; }
+
+  void reduce() {
+    char op = operators.back();
+    operators.pop_back();
+    int32_t right = operands.back();
+    operands.pop_back();
+    int32_t left = operands.back();
+    operands.back() = arena.add(
+        op == SYMBOL_OR ? NodeType::OR : NodeType::CONCAT, op, left, right);
+  }
+
+  void pushOperator(char op) {
+    while (!operators.empty() && operators.back() != SYMBOL_LPAREN &&
+           precedence(operators.back()) >= precedence(op)) {
+      reduce();
+    }
+    operators.push_back(op);
+  }
+
+  int32_t parse() {
+    // Whether the next character starts an operand rather than following one
+    bool expectOperand = true;
+    for (char c : input) {
+      if (isSymbol(c) || c == SYMBOL_LPAREN) {
+        if (!expectOperand) {
+          pushOperator(SYMBOL_CONCAT);
+        }
+        if (c == SYMBOL_LPAREN) {
+          operators.push_back(SYMBOL_LPAREN);
+        } else {
+          operands.push_back(arena.add(NodeType::POSITION, c));
+        }
+        expectOperand = c == SYMBOL_LPAREN;
+      } else if (c == SYMBOL_RPAREN || c == SYMBOL_OR) {
+        // There is no self positions for empty node
+        if (expectOperand) {
+          operands.push_back(arena.add(NodeType::EMPTY, SYMBOL_EMPTY));
+        }
+        if (c == SYMBOL_OR) {
+          pushOperator(SYMBOL_OR);
+          expectOperand = true;
+          continue;
+        }
+        while (!operators.empty() && operators.back() != SYMBOL_LPAREN) {
+          reduce();
+        }
+        if (!operators.empty()) {
+          operators.pop_back();
+        }
+        expectOperand = false;
+      } else if (c == SYMBOL_REPEAT && !expectOperand) {
+        operands.back() = arena.add(NodeType::REPEAT, c, operands.back());
+      }
+    }
+    if (expectOperand) {
+      operands.push_back(arena.add(NodeType::EMPTY, SYMBOL_EMPTY));
+    }
+    while (!operators.empty()) {
+      if (operators.back() == SYMBOL_LPAREN) {
+        operators.pop_back();
+      } else {
+        reduce();
+      }
+    }
+    int32_t end = arena.add(NodeType::POSITION, SYMBOL_NUMBER_SIGN);
+    return arena.add(NodeType::CONCAT, SYMBOL_CONCAT, operands.back(), end);
+  }
+};
+
+constexpr uint32_t DEAD_STATE = UINT32_MAX;
+constexpr uint8_t NO_COLUMN = UINT8_MAX;
+
+// Automaton with integer state ids and a row-major transition table indexed
+// by [state][column]. Symbols that always lead to the same state share a
+// column, so columnOf maps the symbols of alphabet many-to-one onto
+// columnCount columns; they are told apart again only when the automaton is
+// converted or written. State 0 is initial and DEAD_STATE marks a missing
+// transition. Names are optional and only used when converting to DFA.
+struct CompactDFA {
+
+  std::string alphabet{};
+  std::array<uint8_t, 256> columnOf{};
+  size_t columnCount = 0;
+  size_t stateCount = 0;
+  std::vector<uint32_t> transitions{};
+  std::vector<uint64_t> accept{};
+  std::vector<std::string> names{};
+  // With several patterns compiled together, the ids of the patterns each
+  // state accepts, patternWords words per state. Empty for one pattern.
+  size_t patternCount = 1;
+  size_t patternWords = 0;
+  std::vector<uint64_t> patterns{};
+
+  // One column per symbol
+  CompactDFA(const std::string &alphabet = "")
+      : alphabet(alphabet), columnCount(alphabet.size()) {
+    columnOf.fill(NO_COLUMN);
+    for (size_t i = 0; i < alphabet.size(); ++i) {
+      columnOf[static_cast<unsigned char>(alphabet[i])] = i;
+    }
+  }
+
+  CompactDFA(const std::string &alphabet,
+             const std::array<uint8_t, 256> &columnOf, size_t columnCount)
+      : alphabet(alphabet), columnOf(columnOf), columnCount(columnCount) {}
+
+  size_t columns() const { return columnCount; }
+
+  uint32_t nextBySymbol(uint32_t state, char c) const {
+    return next(state, columnOf[static_cast<unsigned char>(c)]);
+  }
+
+  uint32_t addState() {
+    transitions.resize(transitions.size() + columns(), DEAD_STATE);
+    if (stateCount % 64 == 0) {
+      accept.push_back(0);
+    }
+    patterns.resize(patterns.size() + patternWords, 0);
+    return stateCount++;
+  }
+
+  void setPatternCount(size_t count) {
+    patternCount = count;
+    patternWords = count > 1 ? (count + 63) / 64 : 0;
+    patterns.assign(stateCount * patternWords, 0);
+  }
+
+  uint64_t *patternsOf(uint32_t state) {
+    return patterns.data() + state * patternWords;
+  }
+
+  const uint64_t *patternsOf(uint32_t state) const {
+    return patterns.data() + state * patternWords;
+  }
+
+  // Makes state final if set holds any end marker and records which
+  // patterns those markers end. endPositions[i] is the marker of pattern i.
+  void markAccepting(uint32_t state, const uint64_t *set,
+                     const std::vector<int32_t> &endPositions) {
+    for (size_t i = 0; i < endPositions.size(); ++i) {
+      if (PositionSet::contains(set, endPositions[i])) {
+        makeFinal(state);
+        if (patternWords > 0) {
+          PositionSet::insert(patternsOf(state), i);
+        }
+      }
+    }
+  }
+
+  uint32_t next(uint32_t state, size_t column) const {
+    return transitions[state * columns() + column];
+  }
+
+  void setTransition(uint32_t from, size_t column, uint32_t to) {
+    transitions[from * columns() + column] = to;
+  }
+
+  bool isFinal(uint32_t state) const {
+    return PositionSet::contains(accept.data(), state);
+  }
+
+  void makeFinal(uint32_t state) { PositionSet::insert(accept.data(), state); }
+
+  std::string stateName(uint32_t state) const {
+    return names.empty() ? std::to_string(state) : names[state];
+  }
+
+  // Builds the equivalent api.hpp automaton in one pass.
+  DFA toDFA() const;
+
+  // Writes the re2dfa.out text of the automaton into out, replacing its
+  // contents but keeping its capacity. The text is identical to
+  // toDFA().to_string(); states without names get their numeric ids.
+  void write(std::string &out) const;
+};
+
+// Glushkov automaton of one expression: the initial position set, every
+// position's followpos set and, per column, the set of positions labelled
+// with the smallest symbol of that column's class. The other symbols of a
+// class lead to the same sets, so that one symbol stands for them all.
+// Unlike the NodeArena it is copied from, it is self-contained and outlives
+// the compilation.
+struct PositionAutomaton {
+
+  std::string alphabet{};
+  std::array<uint8_t, 256> columnOf{};
+  size_t columnCount = 0;
+  size_t positionCount = 0;
+  size_t wordsPerSet = 0;
+  // End marker of every pattern, in pattern order
+  std::vector<int32_t> endPositions{};
+  std::vector<uint64_t> initial{};
+  std::vector<uint64_t> followpos{};
+  std::vector<uint64_t> columnPositions{};
+
+  PositionAutomaton() = default;
+  PositionAutomaton(NodeArena &arena, int32_t root);
+
+  size_t columns() const { return columnCount; }
+
+  // Bytes of the sets held
+  size_t bytes() const {
+    return (initial.size() + followpos.size() + columnPositions.size()) *
+               sizeof(uint64_t) +
+           endPositions.size() * sizeof(int32_t);
+  }
+
+  const uint64_t *followposOf(size_t pos) const {
+    return &followpos[pos * wordsPerSet];
+  }
+
+  const uint64_t *positionsOf(size_t column) const {
+    return &columnPositions[column * wordsPerSet];
+  }
+
+  bool isFinal(const uint64_t *set) const {
+    return std::any_of(endPositions.begin(), endPositions.end(),
+                       [set](int32_t pos) {
+                         return PositionSet::contains(set, pos);
+                       });
+  }
+
+  // Writes the set reached from set by the symbol of column into res.
+  void step(const uint64_t *set, size_t column, uint64_t *res) const {
+    const uint64_t *labelled = positionsOf(column);
+    std::fill(res, res + wordsPerSet, 0);
+    for (size_t i = 0; i < wordsPerSet; ++i) {
+      uint64_t word = set[i] & labelled[i];
+      while (word) {
+        size_t pos = i * 64 + __builtin_ctzll(word);
+        PositionSet::unite(res, followposOf(pos), wordsPerSet);
+        word &= word - 1;
+      }
+    }
+  }
+};
+
+constexpr uint32_t UNKNOWN_STATE = UINT32_MAX - 1;
+
+// DFA whose states are built on demand from a PositionAutomaton while
+// matching, in the spirit of RE2. States live in a cache that grows with
+// the states built, up to a memory budget; when it is full the whole cache
+// is flushed and rebuilt as needed, so memory stays bounded even for
+// patterns whose full DFA is exponential.
+// State 0 is always the initial state. Ids other than 0 are invalidated by a
+// flush, so callers should only hold on to the state returned last. One
+// instance must not be used by two threads at once.
+struct LazyDFA {
+
+  PositionAutomaton automaton;
+  size_t maxStates = 0;
+  size_t stateCount = 0;
+  size_t flushes = 0;
+  // Position set of state s is sets[s * wordsPerSet ..], its row in
+  // transitions is [s * columns ..] and it is found again through the open
+  // addressing table buckets, which holds state ids.
+  std::vector<uint64_t> sets{};
+  std::vector<uint32_t> transitions{};
+  std::vector<uint8_t> finals{};
+  std::vector<uint32_t> buckets{};
+
+  LazyDFA(PositionAutomaton automaton, size_t memoryBudget = 8 << 20);
+  LazyDFA(const LazyDFA &) = delete;
+  LazyDFA &operator=(const LazyDFA &) = delete;
+
+  bool isFinal(uint32_t state) const { return finals[state]; }
+
+  uint32_t next(uint32_t state, unsigned char c) {
+    uint8_t column = automaton.columnOf[c];
+    if (column == NO_COLUMN) {
+      return DEAD_STATE;
+    }
+    uint32_t to = transitions[state * automaton.columns() + column];
+    return to == UNKNOWN_STATE ? computeNext(state, column) : to;
+  }
+
+  bool match(std::string_view input) {
+    uint32_t state = 0;
+    for (char c : input) {
+      state = next(state, c);
+      if (state == DEAD_STATE) {
+        return false;
+      }
+    }
+    return isFinal(state);
+  }
+
+  uint32_t computeNext(uint32_t state, size_t column);
+  uint32_t findOrAdd(const uint64_t *set);
+  void growBuckets();
+  void flush();
+};
+
+// Language of the product of two automata. Two regexes are equivalent if
+// their symmetric difference has no word, and the first is contained in the
+// second if their difference has none.
+enum class ProductOperation { INTERSECTION, DIFFERENCE, SYMMETRIC_DIFFERENCE };
+
+// Outcome of a search for a word. The status is MEMORY_LIMIT if a lazy DFA
+// had to flush its cache, which renumbers its states, before the search
+// ended; found and witness say nothing then.
+struct WordSearch {
+  CompileStatus status = CompileStatus::OK;
+  bool found = false;
+  // A shortest word of the language if one was found
+  std::string witness{};
+  // Product states reached by the search
+  size_t pairs = 0;
+};
+
+// Breadth-first search for a word of the language of dfa, so it is empty if
+// none is found.
+WordSearch findWord(LazyDFA &dfa);
+
+// Breadth-first search for a word of the product of a and b that expands
+// only reachable pairs of states, computing the transitions it needs on the
+// fly, and stops at the first accepting pair. Pairs that cannot accept any
+// more, such as those with a dead state in an intersection, are pruned.
+WordSearch findWord(LazyDFA &a, LazyDFA &b, ProductOperation operation);
+
+// Bit-parallel (Shift-And style) simulation of the position automaton that
+// never runs subset construction. The current state is the set of positions
+// that may be read next; a byte keeps the positions labelled with it and
+// replaces them by the union of their followpos sets. That union is looked
+// up eight positions at a time in followTable, which holds the union for
+// every byte value of every 8-position chunk of a set, so one step costs a
+// few table rows per nonzero byte of the set instead of one row per
+// position. Tables take 16 KiB times wordsPerSet squared.
+struct BitParallelMatcher {
+
+  // Bytes taken by the tables of a matcher for sets of wordsPerSet words
+  static size_t tableBytes(size_t wordsPerSet) {
+    return (wordsPerSet * 8 * 256 * wordsPerSet + 256 * wordsPerSet +
+            2 * wordsPerSet) *
+           sizeof(uint64_t);
+  }
+
+  size_t wordsPerSet = 0;
+  size_t positionCount = 0;
+  std::vector<uint64_t> initial{};
+  // End markers of all patterns
+  std::vector<uint64_t> finalMask{};
+  // Positions labelled with each byte, wordsPerSet words per byte value
+  std::vector<uint64_t> symbolMasks{};
+  // Row chunk * 256 + b is the followpos union of the positions 8 * chunk + i
+  // for every bit i set in b
+  std::vector<uint64_t> followTable{};
+
+  BitParallelMatcher(const PositionAutomaton &automaton);
+
+  bool match(std::string_view input) const;
+};
+
+// Merges equivalent states with Hopcroft's algorithm. States that cannot
+// reach an accepting state are removed; the result is numbered from 0 in
+// breadth-first order and has no names.
+CompactDFA minimize(const CompactDFA &dfa);
+
+// Byte-driven matcher over tables it does not own. Every byte maps to a
+// column, with column 0 shared by all bytes outside the alphabet, and the
+// table stores the row offset of each target state, so one step is a single
+// dependent load. Row 0 is the dead state and absorbs every input; accept is
+// a bitset indexed by row offset. The tables come from a Matcher or straight
+// from a mapped MappedDFA file.
+struct MatcherView {
+
+  const uint8_t *columnOf = nullptr;
+  const uint32_t *table = nullptr;
+  const uint64_t *accept = nullptr;
+  size_t columns = 0;
+  size_t rows = 0;
+  uint32_t start = 0;
+
+  bool isFinal(uint32_t state) const {
+    return PositionSet::contains(accept, state);
+  }
+
+  uint32_t step(uint32_t state, unsigned char c) const {
+    return table[state + columnOf[c]];
+  }
+
+  // Whole-input match. Gives up as soon as the dead state is reached.
+  bool match(std::string_view input) const { return isFinal(run(input)); }
+
+  // Row offset of the state reached on input, 0 once the dead state is hit.
+  uint32_t run(std::string_view input) const {
+    const uint32_t *next = table;
+    const uint8_t *column = columnOf;
+    auto it = reinterpret_cast<const unsigned char *>(input.data());
+    auto end = it + input.size();
+    uint32_t state = start;
+    // The dead state is absorbing, so checking it once per block is enough
+    while (end - it >= 8) {
+      state = next[state + column[it[0]]];
+      state = next[state + column[it[1]]];
+      state = next[state + column[it[2]]];
+      state = next[state + column[it[3]]];
+      state = next[state + column[it[4]]];
+      state = next[state + column[it[5]]];
+      state = next[state + column[it[6]]];
+      state = next[state + column[it[7]]];
+      if (state == 0) {
+        return 0;
+      }
+      it += 8;
+    }
+    for (; it != end; ++it) {
+      state = next[state + column[*it]];
+    }
+    return state;
+  }
+
+  // True if some prefix of input, possibly empty, is in the language.
+  bool matchPrefix(std::string_view input) const {
+    uint32_t state = start;
+    for (char c : input) {
+      if (isFinal(state)) {
+        return true;
+      }
+      state = step(state, c);
+      if (state == 0) {
+        return false;
+      }
+    }
+    return isFinal(state);
+  }
+
+  // Length of the longest prefix of input in the language, or -1 if there is
+  // none. Stops reading at the dead state.
+  std::ptrdiff_t longestMatch(std::string_view input) const {
+    std::ptrdiff_t res = isFinal(start) ? 0 : -1;
+    uint32_t state = start;
+    for (size_t i = 0; i < input.size(); ++i) {
+      state = step(state, input[i]);
+      if (state == 0) {
+        break;
+      }
+      if (isFinal(state)) {
+        res = i + 1;
+      }
+    }
+    return res;
+  }
+
+  // Whole-input match of count inputs at once: bit i of res, resized to
+  // (count + 63) / 64 words, is set if inputs[i] is in the language. Inputs
+  // of any length advance eight at a time through the table in lockstep,
+  // so eight independent loads are in flight where one input has one. The
+  // lanes take inputs ordered by length a few hundred at a time, run
+  // without checks until the first of them ends and are then refilled.
+  void matchMany(const std::string_view *inputs, size_t count,
+                 std::vector<uint64_t> &res) const;
+
+  // Converts the tables back to a CompactDFA with numeric state names.
+  CompactDFA toCompactDFA() const;
+};
+
+// Matcher that owns its tables, built from a CompactDFA. Throws
+// std::invalid_argument for a DFA without states, such as the one returned
+// when construction passes a limit.
+struct Matcher : MatcherView {
+
+  std::array<uint8_t, 256> columnStorage{};
+  std::vector<uint32_t> tableStorage{};
+  std::vector<uint64_t> acceptStorage{};
+
+  Matcher(const CompactDFA &dfa);
+  Matcher(const Matcher &other) { *this = other; }
+
+  Matcher &operator=(const Matcher &other) {
+    static_cast<MatcherView &>(*this) = other;
+    columnStorage = other.columnStorage;
+    tableStorage = other.tableStorage;
+    acceptStorage = other.acceptStorage;
+    bind();
+    return *this;
+  }
+
+  void bind() {
+    columnOf = columnStorage.data();
+    table = tableStorage.data();
+    accept = acceptStorage.data();
+  }
+};
+
+// Matcher for an automaton compiled from several patterns that reports every
+// pattern the input matches in one pass. The ids of the patterns accepted by
+// each row are stored as a bitset of patternWords words; lower ids win when
+// the caller wants a single pattern.
+struct MultiMatcher {
+
+  Matcher matcher;
+  size_t patternCount = 0;
+  size_t patternWords = 0;
+  // patternWords words per row, row 0 (the dead state) accepting nothing
+  std::vector<uint64_t> patterns{};
+
+  MultiMatcher(const CompactDFA &dfa);
+
+  const uint64_t *patternsOf(uint32_t state) const {
+    return &patterns[state / matcher.columns * patternWords];
+  }
+
+  // Patterns that match the whole input.
+  const uint64_t *match(std::string_view input) const {
+    return patternsOf(matcher.run(input));
+  }
+
+  // Highest priority pattern that matches the whole input, or -1.
+  std::ptrdiff_t firstMatch(std::string_view input) const;
+
+  // Ors into res, resized to patternWords, every pattern that matches some
+  // prefix of input.
+  void matchPrefixes(std::string_view input, std::vector<uint64_t> &res) const;
+};
+
+// Read-only view of a whole file. It is memory-mapped where the platform
+// supports it and read into memory otherwise.
+struct MappedFile {
+
+  std::string path;
+  const char *data = nullptr;
+  size_t size = 0;
+  std::vector<uint64_t> buffer{};
+  bool mapped = false;
+
+  MappedFile(const std::string &path = "") : path(path) {}
+  MappedFile(const MappedFile &) = delete;
+  MappedFile(MappedFile &&other);
+  MappedFile &operator=(MappedFile &&other);
+  ~MappedFile();
+
+  bool open();
+  void close();
+};
+
+constexpr uint32_t DFA_FILE_VERSION = 2;
+
+// On-disk layout of a compiled automaton, in native byte order. The header
+// is followed by the 256-byte symbol map and the key the file was written
+// for, then the MatcherView table and accept bitset at 8-byte aligned
+// offsets, so a mapped file is matched on in place. State names, if any,
+// come last, one per row after the dead one, each ended by '\n'.
+struct DFAFileHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint32_t columns;
+  uint32_t rows;
+  uint32_t start;
+  uint32_t keySize;
+  uint32_t reserved;
+  uint64_t tableOffset;
+  uint64_t acceptOffset;
+  uint64_t namesOffset;
+  uint64_t namesSize;
+  uint64_t fileSize;
+};
+
+// Serializes the tables of matcher in the DFAFileHeader format, with names,
+// if not empty, as the names of its states in CompactDFA order.
+std::string serializeDFA(const MatcherView &matcher, const std::string &key,
+                         const std::vector<std::string> &names = {});
+
+// Compiled automaton loaded from disk
+struct MappedDFA {
+
+  MappedFile file{};
+  MatcherView matcher{};
+  // The names section, empty if the states have no names
+  std::string_view names{};
+
+  // Maps path and checks that it is a well-formed file written for key.
+  bool open(const std::string &path, const std::string &key);
+
+  // Converts the tables back to a CompactDFA, with the stored names if any.
+  CompactDFA toCompactDFA() const;
+};
+
+// Directory of compiled automata addressed by a hash of their key, which
+// holds the pattern and every option that changes the automaton.
+struct CompileCache {
+
+  std::string directory;
+
+  static std::string keyFor(const std::string &s, bool minimized,
+                            bool named = false);
+
+  std::string pathFor(const std::string &key) const;
+
+  bool load(const std::string &key, MappedDFA &dfa) const;
+
+  // Writes through a temporary file and a rename, so concurrent readers
+  // never see a partial file. names are stored as by serializeDFA.
+  bool store(const std::string &key, const MatcherView &matcher,
+             const std::vector<std::string> &names = {}) const;
+};
+
+inline const char *statusName(CompileStatus status) {
+  switch (status) {
+  case CompileStatus::OK:
+    return "ok";
+  case CompileStatus::STATE_LIMIT:
+    return "state_limit";
+  case CompileStatus::MEMORY_LIMIT:
+    return "memory_limit";
+  case CompileStatus::TIME_LIMIT:
+    return "time_limit";
+  }
+  return "unknown";
+}
+
+// Upper bound of thread and job counts taken from the command line
+constexpr size_t MAX_THREADS = 1024;
+
+// Parses a command-line count made of decimal digits only, so a sign or
+// trailing garbage is rejected rather than wrapped or ignored. Returns false
+// if text is not such a count or is above max.
+inline bool parseCount(const char *text, size_t max, size_t &value) {
+  const char *end = text + std::strlen(text);
+  unsigned long long parsed = 0;
+  auto res = std::from_chars(text, end, parsed);
+  if (text == end || res.ec != std::errc() || res.ptr != end ||
+      parsed > max) {
+    return false;
+  }
+  value = parsed;
+  return true;
+}
+
+// Parses a non-negative number of milliseconds, fractions allowed
+inline bool parseMilliseconds(const char *text, double &value) {
+  if (!std::isdigit(static_cast<unsigned char>(text[0])) && text[0] != '.') {
+    return false;
+  }
+  char *end = nullptr;
+  double parsed = std::strtod(text, &end);
+  if (*end != '\0' || !(parsed >= 0 && parsed <= 1e12)) {
+    return false;
+  }
+  value = parsed;
+  return true;
+}
+
+// Counters of one compilation. They are cheap enough to be always on, unlike
+// RE2DFA_TRACE.
+struct CompileStats {
+  size_t positions = 0;
+  // Syntax tree nodes and the distinct shapes they were hash-consed into
+  size_t nodes = 0;
+  size_t shapes = 0;
+  // Columns of the transition table: classes of symbols that behave alike
+  size_t columns = 0;
+  size_t states = 0;
+  size_t transitions = 0;
+  // Position sets looked up in the state map, and the lookups that found an
+  // existing state
+  size_t lookups = 0;
+  size_t duplicateHits = 0;
+  // Sizes of the position sets of all states
+  size_t totalSetSize = 0;
+  size_t maxSetSize = 0;
+  size_t minimizedStates = 0;
+
+  double parseMs = 0;
+  double subsetMs = 0;
+  double minimizeMs = 0;
+  double toDFAMs = 0;
+  double writeMs = 0;
+
+  // How the last construction ended and the most bytes it held at once
+  CompileStatus status = CompileStatus::OK;
+  size_t peakBytes = 0;
+
+  void addSet(size_t size) {
+    totalSetSize += size;
+    maxSetSize = std::max(maxSetSize, size);
+  }
+
+  // One "name value" pair per line
+  std::string toString() const {
+    std::string res{};
+    auto add = [&res](const char *name, const std::string &value) {
+      res += name;
+      res += ' ';
+      res += value;
+      res += '\n';
+    };
+    add("positions", std::to_string(positions));
+    add("nodes", std::to_string(nodes));
+    add("shapes", std::to_string(shapes));
+    add("columns", std::to_string(columns));
+    add("states", std::to_string(states));
+    add("transitions", std::to_string(transitions));
+    add("lookups", std::to_string(lookups));
+    add("duplicate_hits", std::to_string(duplicateHits));
+    add("total_set_size", std::to_string(totalSetSize));
+    add("max_set_size", std::to_string(maxSetSize));
+    add("minimized_states", std::to_string(minimizedStates));
+    add("status", statusName(status));
+    add("peak_bytes", std::to_string(peakBytes));
+    add("parse_ms", std::to_string(parseMs));
+    add("subset_ms", std::to_string(subsetMs));
+    add("minimize_ms", std::to_string(minimizeMs));
+    add("to_dfa_ms", std::to_string(toDFAMs));
+    add("write_ms", std::to_string(writeMs));
+    return res;
+  }
+};
+
+// Stores the wall time of its own lifetime into target, in milliseconds.
+struct PhaseTimer {
+  double &target;
+  std::chrono::steady_clock::time_point start;
+
+  PhaseTimer(double &target)
+      : target(target), start(std::chrono::steady_clock::now()) {}
+
+  ~PhaseTimer() {
+    target = std::chrono::duration<double, std::milli>(
+                 std::chrono::steady_clock::now() - start)
+                 .count();
+  }
+};
+
+// Subset construction on several threads. Each thread expands states from
+// its own work-stealing frontier and new sets are registered in a sharded
+// concurrent map; states are renumbered at the end so the result, names
+// included, is identical to the single-threaded construction.
+// With a budget it stops at the first limit passed, recorded in the budget,
+// and returns an automaton without states.
+CompactDFA buildParallel(const PositionAutomaton &automaton, size_t threads,
+                         CompileStats *stats = nullptr, bool named = true,
+                         CompileBudget *budget = nullptr);
+
+struct CompileOptions {
+  bool minimize = false;
+  size_t threads = 1;
+  // Name states by their position sets instead of their numeric ids
+  bool named = true;
+  // Limits of the construction, 0 meaning none. An automaton that passes
+  // one is dropped.
+  size_t maxStates = 0;
+  size_t maxBytes = 0;
+  double maxMs = 0;
+  // Whether tryBuild falls back to simulating the position automaton when
+  // a limit is passed
+  bool fallback = false;
+};
+
+// Outcome of CompileContext::tryBuild. dfa is complete only when status is
+// OK; otherwise dfa has no states and fallback, if requested, matches the
+// same language without a DFA. The fallback replaces the dropped automaton,
+// so it is only built if its tables, fallbackBytes in all, fit in maxBytes
+// on their own; otherwise it stays null.
+struct CompileResult {
+  CompileStatus status = CompileStatus::OK;
+  CompactDFA dfa{};
+  std::unique_ptr<BitParallelMatcher> fallback{};
+  size_t fallbackBytes = 0;
+
+  bool ok() const { return status == CompileStatus::OK; }
+};
+
+// Thrown where an automaton is handed back as an api.hpp DFA, which cannot
+// be cut short: by CompileContext::compile and re2dfa once a limit of their
+// options is passed.
+struct CompileError : std::runtime_error {
+  CompileStatus status;
+
+  CompileError(CompileStatus status)
+      : std::runtime_error(std::string("construction stopped: ") +
+                           statusName(status)),
+        status(status) {}
+};
+
+// Everything one compilation needs. Contexts can be reused to keep their
+// buffers warm, but a single context must not be used by two threads at once;
+// give each thread its own.
+struct CompileContext {
+  NodeArena arena{};
+  // Counters of the last compilation, reset whenever a new expression is
+  // parsed
+  CompileStats stats{};
+
+  // Parses s into arena and returns its root. The arena is charged to
+  // budget, if given; followpos, which grows with the square of the
+  // positions, is charged before it is allocated, and if that passes a limit
+  // nothing is parsed and NO_NODE is returned.
+  int32_t parse(const std::string &s, CompileBudget *budget = nullptr);
+
+  // Parses every pattern into arena with an end marker of its own and
+  // returns the root of their union. Pattern i ends with the i-th marker.
+  // budget is charged as by parse.
+  int32_t parsePatterns(const std::vector<std::string> &patterns,
+                        CompileBudget *budget = nullptr);
+
+  // Parses s and copies out its position automaton.
+  PositionAutomaton positions(const std::string &s);
+
+  // Runs subset construction over the followpos sets of s.
+  CompactDFA build(const std::string &s);
+
+  // Subset construction alone, for an expression already parsed into arena.
+  // With a budget it stops at the first limit passed, recorded in the
+  // budget, and returns the states built so far.
+  CompactDFA construct(int32_t root, bool named = true,
+                       CompileBudget *budget = nullptr);
+
+  // Honours the limits of options. An automaton cut short comes back without
+  // states and stats.status tells which limit was passed.
+  CompactDFA build(const std::string &s, const CompileOptions &options);
+
+  // build with the outcome spelled out, and a fallback matcher if asked for.
+  CompileResult tryBuild(const std::string &s, const CompileOptions &options);
+
+  // One automaton for all patterns whose accepting states carry the ids of
+  // the patterns they accept.
+  CompactDFA buildPatterns(const std::vector<std::string> &patterns,
+                           const CompileOptions &options = {});
+
+  // Subset construction and minimization for a root parsed into arena
+  // against budget, whose limits are those of options.
+  CompactDFA buildParsed(int32_t root, const CompileOptions &options,
+                         CompileBudget &budget);
+
+  // build converted to an api.hpp DFA. Throws CompileError if a limit of
+  // options is passed.
+  DFA compile(const std::string &s, const CompileOptions &options = {});
+
+  // Scratch of construct: the position set of every state, an
+  // open-addressing table of state ids keyed by those sets, and two sets
+  // being worked on
+  std::vector<uint64_t> stateSets{};
+  std::vector<uint32_t> stateTable{};
+  std::vector<uint64_t> scratchSets{};
+
+  // Slot of stateTable that holds set, or the empty slot where it belongs
+  size_t stateSlot(const uint64_t *set) const;
+
+  // Doubles stateTable and reinserts the first states states
+  void growStateTable(size_t states);
+};
+
+// Compiles s with a context private to the calling thread, so it is safe to
+// call from any number of threads concurrently. Throws CompileError if a
+// limit of options is passed.
+DFA re2dfa(const std::string &s);
+DFA re2dfa(const std::string &s, const CompileOptions &options);
+
+// Counters of the last re2dfa call on the calling thread.
+const CompileStats &re2dfaStats();
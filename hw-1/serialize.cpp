@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "re2dfa.hpp"
+
+constexpr char DFA_FILE_MAGIC[4] = {'R', '2', 'D', 'F'};
+constexpr uint32_t DFA_FILE_BYTE_ORDER = 0x01020304;
+
+namespace {
+
+size_t alignTo8(size_t offset) { return (offset + 7) / 8 * 8; }
+
+} // namespace
+
+std::string serializeDFA(const MatcherView &matcher, const std::string &key,
+                         const std::vector<std::string> &names) {
+  size_t cells = matcher.rows * matcher.columns;
+  DFAFileHeader header{};
+  std::memcpy(header.magic, DFA_FILE_MAGIC, sizeof(header.magic));
+  header.version = DFA_FILE_VERSION;
+  header.byteOrder = DFA_FILE_BYTE_ORDER;
+  header.columns = matcher.columns;
+  header.rows = matcher.rows;
+  header.start = matcher.start;
+  header.keySize = key.size();
+  header.tableOffset = alignTo8(sizeof(header) + 256 + key.size());
+  header.acceptOffset =
+      alignTo8(header.tableOffset + cells * sizeof(uint32_t));
+  header.namesOffset =
+      header.acceptOffset + (cells + 63) / 64 * sizeof(uint64_t);
+  for (const std::string &name : names) {
+    header.namesSize += name.size() + 1;
+  }
+  header.fileSize = header.namesOffset + header.namesSize;
+
+  std::string res(header.fileSize, '\0');
+  std::memcpy(&res[0], &header, sizeof(header));
+  std::memcpy(&res[sizeof(header)], matcher.columnOf, 256);
+  std::memcpy(&res[sizeof(header) + 256], key.data(), key.size());
+  std::memcpy(&res[header.tableOffset], matcher.table,
+              cells * sizeof(uint32_t));
+  std::memcpy(&res[header.acceptOffset], matcher.accept,
+              (cells + 63) / 64 * sizeof(uint64_t));
+  size_t offset = header.namesOffset;
+  for (const std::string &name : names) {
+    std::memcpy(&res[offset], name.data(), name.size());
+    offset += name.size();
+    res[offset++] = '\n';
+  }
+  return res;
+}
+
+bool MappedDFA::open(const std::string &path, const std::string &key) {
+  matcher = MatcherView{};
+  file = MappedFile(path);
+  if (!file.open() || file.size < sizeof(DFAFileHeader) + 256) {
+    return false;
+  }
+
+  DFAFileHeader header{};
+  std::memcpy(&header, file.data, sizeof(header));
+  // The table must fit in the file before its size is computed, which
+  // could otherwise wrap around
+  if (header.columns == 0 ||
+      header.rows > file.size / sizeof(uint32_t) / header.columns) {
+    return false;
+  }
+  size_t cells = size_t(header.rows) * header.columns;
+  if (std::memcmp(header.magic, DFA_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != DFA_FILE_VERSION ||
+      header.byteOrder != DFA_FILE_BYTE_ORDER ||
+      header.fileSize != file.size || header.rows == 0 || header.columns == 0 ||
+      header.keySize != key.size() ||
+      header.tableOffset != alignTo8(sizeof(header) + 256 + key.size()) ||
+      header.acceptOffset !=
+          alignTo8(header.tableOffset + cells * sizeof(uint32_t)) ||
+      header.namesOffset !=
+          header.acceptOffset + (cells + 63) / 64 * sizeof(uint64_t) ||
+      header.namesOffset > header.fileSize ||
+      header.namesSize != header.fileSize - header.namesOffset ||
+      std::memcmp(file.data + sizeof(header) + 256, key.data(),
+                  key.size()) != 0) {
+    return false;
+  }
+
+  matcher.columnOf =
+      reinterpret_cast<const uint8_t *>(file.data + sizeof(header));
+  matcher.table =
+      reinterpret_cast<const uint32_t *>(file.data + header.tableOffset);
+  matcher.accept =
+      reinterpret_cast<const uint64_t *>(file.data + header.acceptOffset);
+  matcher.columns = header.columns;
+  matcher.rows = header.rows;
+  matcher.start = header.start;
+  names = std::string_view(file.data + header.namesOffset, header.namesSize);
+
+  // A single pass guarantees that matching never reads outside the table
+  bool inBounds =
+      header.start < cells && header.start % header.columns == 0 &&
+      std::all_of(matcher.columnOf, matcher.columnOf + 256,
+                  [&header](uint8_t column) {
+                    return column < header.columns;
+                  }) &&
+      std::all_of(matcher.table, matcher.table + cells,
+                  [cells, &header](uint32_t offset) {
+                    return offset < cells && offset % header.columns == 0;
+                  }) &&
+      (names.empty() || (names.back() == '\n' &&
+                         size_t(std::count(names.begin(), names.end(),
+                                           '\n')) == header.rows - 1));
+  return inBounds;
+}
+
+CompactDFA MappedDFA::toCompactDFA() const {
+  CompactDFA res = matcher.toCompactDFA();
+  for (size_t begin = 0; begin < names.size();) {
+    size_t end = names.find('\n', begin);
+    res.names.emplace_back(names.substr(begin, end - begin));
+    begin = end + 1;
+  }
+  return res;
+}
+
+std::string CompileCache::keyFor(const std::string &s, bool minimized,
+                                 bool named) {
+  std::string res = s + '\0' + (minimized ? "minimized" : "raw");
+  if (named) {
+    res += '\0';
+    res += "named";
+  }
+  return res;
+}
+
+std::string CompileCache::pathFor(const std::string &key) const {
+  // FNV-1a, as for position sets
+  uint64_t h = 14695981039346656037ull;
+  for (unsigned char c : key) {
+    h = (h ^ c) * 1099511628211ull;
+  }
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.r2dfa",
+                static_cast<unsigned long long>(h));
+  return (std::filesystem::path(directory) / name).string();
+}
+
+bool CompileCache::load(const std::string &key, MappedDFA &dfa) const {
+  return dfa.open(pathFor(key), key);
+}
+
+bool CompileCache::store(const std::string &key, const MatcherView &matcher,
+                         const std::vector<std::string> &names) const {
+  std::error_code error{};
+  std::filesystem::create_directories(directory, error);
+  if (error) {
+    return false;
+  }
+
+  std::string path = pathFor(key);
+  size_t thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+  auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+  std::string temporary =
+      path + ".tmp" + std::to_string(thread) + "." + std::to_string(now);
+  {
+    std::ofstream out(temporary, std::ios::binary);
+    std::string bytes = serializeDFA(matcher, key, names);
+    out.write(bytes.data(), bytes.size());
+    if (!out) {
+      std::remove(temporary.c_str());
+      return false;
+    }
+  }
+  std::filesystem::rename(temporary, path, error);
+  if (error) {
+    std::remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
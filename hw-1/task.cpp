@@ -1,471 +1,453 @@
-#include <algorithm>
-#include <cctype>
 #include <iostream>
-#include <map>
-#include <memory>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 #include "api.hpp"
-
-void log(const std::string &str) {
-#ifdef DEBUG
-  std::cout << str << std::endl;
-#endif
-}
-
-constexpr char SYMBOL_OR = '|';
-constexpr char SYMBOL_CONCAT = '.';
-constexpr char SYMBOL_REPEAT = '*';
-constexpr char SYMBOL_LPAREN = '(';
-constexpr char SYMBOL_RPAREN = ')';
-constexpr char SYMBOL_EMPTY = '{';
-constexpr char SYMBOL_NUMBER_SIGN = '#';
-constexpr char SYMBOL_HELPER_POSITION = '?';
-constexpr char SYMBOL_ROOT = '@';
-
-enum class TokenType {
-  NODE,
-  END,
-  TOK_LPAREN,
-  TOK_RPAREN,
-  TOK_CONCAT,
-  TOK_OR,
-  TOK_REPEAT,
-  EMPTY,
-};
-
-struct Token {
-  Token(TokenType type, char value) : type(type), value(value) {}
-
-  TokenType type;
-  char value;
-};
-
-int generateReadableNum() {
-  static int num = 1;
-  return num++;
-}
-
-struct PositionNode;
-
-struct BaseNode {
-
-  BaseNode(Token token, bool nullable = false)
-      : token(token), nullable(nullable) {}
-
-  virtual ~BaseNode() {}
-
-  Token token;
-  bool nullable;
-  std::vector<std::shared_ptr<BaseNode>> firstpos{};
-  std::vector<std::shared_ptr<BaseNode>> lastpos{};
-  std::vector<std::shared_ptr<BaseNode>> followpos{};
-
-  int readableNum = generateReadableNum();
-};
-
-struct OrNode : BaseNode {
-
-  OrNode(std::shared_ptr<BaseNode> left, std::shared_ptr<BaseNode> right)
-      : BaseNode(Token(TokenType::TOK_OR, SYMBOL_OR), true) {
-    this->left = left;
-    this->right = right;
-    nullable = left->nullable || right->nullable;
-    std::for_each(
-        left->firstpos.begin(), left->firstpos.end(),
-        [this](std::shared_ptr<BaseNode> node) { firstpos.push_back(node); });
-    std::for_each(
-        left->lastpos.begin(), left->lastpos.end(),
-        [this](std::shared_ptr<BaseNode> node) { lastpos.push_back(node); });
-    std::for_each(
-        right->firstpos.begin(), right->firstpos.end(),
-        [this](std::shared_ptr<BaseNode> node) { firstpos.push_back(node); });
-    std::for_each(
-        right->lastpos.begin(), right->lastpos.end(),
-        [this](std::shared_ptr<BaseNode> node) { lastpos.push_back(node); });
+#include "re2dfa.hpp"
+
+PositionAutomaton::PositionAutomaton(NodeArena &arena, int32_t root)
+    : alphabet(arena.alphabet()),
+      columnCount(arena.symbolClasses(columnOf)),
+      positionCount(arena.positionCount()), wordsPerSet(arena.wordsPerSet),
+      endPositions(arena.symbolToPositions[SYMBOL_NUMBER_SIGN]),
+      followpos(arena.words.begin(),
+                arena.words.begin() + arena.followposWords),
+      columnPositions(columnCount * wordsPerSet, 0) {
+  PositionSet first = arena.firstpos(root);
+  initial.assign(first.words.begin(), first.words.end());
+  std::vector<bool> filled(columnCount, false);
+  for (unsigned char c : alphabet) {
+    if (!filled[columnOf[c]]) {
+      filled[columnOf[c]] = true;
+      for (int32_t pos : arena.symbolToPositions[c]) {
+        PositionSet::insert(&columnPositions[columnOf[c] * wordsPerSet], pos);
+      }
+    }
   }
+}
 
-  virtual ~OrNode(){};
-
-  std::shared_ptr<BaseNode> left;
-  std::shared_ptr<BaseNode> right;
-};
-
-struct RepeatNode : BaseNode {
-
-  RepeatNode(std::shared_ptr<BaseNode> repeatable)
-      : BaseNode(Token(TokenType::TOK_REPEAT, SYMBOL_REPEAT), true) {
-    this->repeatable = repeatable;
-    nullable = true;
-    std::for_each(repeatable->firstpos.begin(), repeatable->firstpos.end(),
-                  [this](std::shared_ptr<BaseNode> node) {
-                    firstpos.push_back(node);
-                    lastpos.push_back(node);
-                  });
-    std::for_each(repeatable->lastpos.begin(), repeatable->lastpos.end(),
-                  [this, &repeatable](std::shared_ptr<BaseNode> node) {
-                    std::for_each(repeatable->firstpos.begin(),
-                                  repeatable->firstpos.end(),
-                                  [this, &node](std::shared_ptr<BaseNode> n) {
-                                    node->followpos.push_back(n);
-                                  });
-                  });
+size_t NodeArena::symbolClasses(std::array<uint8_t, 256> &columnOf) {
+  // A character class is an alternation of single symbols. Every symbol in a
+  // class has a sibling position for each other symbol of the class with the
+  // same followpos and in the same sets, so symbols that occur in exactly
+  // the same classes, a lone symbol being a class of its own, lead every
+  // state to the same set. The positions of a class are consecutive.
+  constexpr uint8_t IS_CLASS = 1;
+  constexpr uint8_t IN_CLASS = 2;
+  nodeClasses.assign(nodes.size(), 0);
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    const Node &node = nodes[i];
+    if (node.type == NodeType::POSITION ||
+        (node.type == NodeType::OR && nodeClasses[node.left] & IS_CLASS &&
+         nodeClasses[node.right] & IS_CLASS)) {
+      nodeClasses[i] |= IS_CLASS;
+    }
+    if (node.type == NodeType::OR && nodeClasses[i] & IS_CLASS) {
+      nodeClasses[node.left] |= IN_CLASS;
+      nodeClasses[node.right] |= IN_CLASS;
+    }
   }
 
-  virtual ~RepeatNode() {}
-
-  std::shared_ptr<BaseNode> repeatable;
-};
-
-struct ConcatNode : BaseNode {
-
-  ConcatNode(std::shared_ptr<BaseNode> left, std::shared_ptr<BaseNode> right)
-      : BaseNode(Token(TokenType::TOK_CONCAT, SYMBOL_CONCAT), true) {
-    this->left = left;
-    this->right = right;
-    nullable = left->nullable && right->nullable;
-    std::for_each(left->firstpos.begin(), left->firstpos.end(),
-                  [this, &right](std::shared_ptr<BaseNode> node) {
-                    firstpos.push_back(node);
-                  });
-    std::for_each(left->lastpos.begin(), left->lastpos.end(),
-                  [this, &right](std::shared_ptr<BaseNode> node) {
-                    if (right->nullable) {
-                      lastpos.push_back(node);
-                    }
-                  });
-    std::for_each(right->firstpos.begin(), right->firstpos.end(),
-                  [this, &left](std::shared_ptr<BaseNode> node) {
-                    if (left->nullable) {
-                      firstpos.push_back(node);
-                    }
-                  });
-    std::for_each(
-        right->lastpos.begin(), right->lastpos.end(),
-        [this](std::shared_ptr<BaseNode> node) { lastpos.push_back(node); });
-    std::for_each(left->lastpos.begin(), left->lastpos.end(),
-                  [this, &right](std::shared_ptr<BaseNode> node) {
-                    std::for_each(right->firstpos.begin(),
-                                  right->firstpos.end(),
-                                  [this, &node](std::shared_ptr<BaseNode> n) {
-                                    node->followpos.push_back(n);
-                                  });
-                  });
+  for (auto &classes : classesOf) {
+    classes.clear();
   }
-
-  virtual ~ConcatNode() {}
-
-  std::shared_ptr<BaseNode> left;
-  std::shared_ptr<BaseNode> right;
-};
-
-std::vector<std::shared_ptr<PositionNode>> positionsGlobal{};
-std::unordered_map<char, std::vector<std::shared_ptr<PositionNode>>>
-    symbolToPositions{};
-
-struct PositionNode : BaseNode, std::enable_shared_from_this<PositionNode> {
-  PositionNode(char name = SYMBOL_HELPER_POSITION, bool nullable = false)
-      : BaseNode(Token(TokenType::NODE, name), nullable), name(name) {}
-
-  virtual ~PositionNode() {}
-
-  void initializePositions() {
-    auto self = shared_from_this();
-    if (!nullable) {
-      firstpos.push_back(self);
-      lastpos.push_back(self);
+  int32_t classCount = 0;
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (nodeClasses[i] != IS_CLASS) {
+      continue;
     }
-    positionsGlobal.push_back(self);
-    if (name != SYMBOL_HELPER_POSITION) {
-      if (symbolToPositions.find(name) == symbolToPositions.end()) {
-        symbolToPositions[name] = {self};
-      } else {
-        symbolToPositions[name].push_back(self);
+    size_t base = nodes[i].base;
+    for (size_t pos = base; pos < base + shapes[nodes[i].shape].span; ++pos) {
+      std::vector<int32_t> &classes =
+          classesOf[static_cast<unsigned char>(positionSymbols[pos])];
+      if (classes.empty() || classes.back() != classCount) {
+        classes.push_back(classCount);
       }
     }
+    ++classCount;
   }
 
-  std::string
-  getPosReadable(const std::vector<std::shared_ptr<BaseNode>> &positions) {
-    if (!conditionName.empty()) {
-      return conditionName;
+  // Each symbol joins the column of the first smaller symbol with the same
+  // classes, found among the first symbols of the columns so far
+  std::array<uint8_t, 256> firstOf{};
+  size_t columns = 0;
+  columnOf.fill(NO_COLUMN);
+  for (int c = 0; c < 256; ++c) {
+    if (c == SYMBOL_NUMBER_SIGN || symbolToPositions[c].empty()) {
+      continue;
     }
-    std::string conditionName = "";
-    for (auto pos : positions) {
-      try {
-        auto position = std::dynamic_pointer_cast<PositionNode>(pos);
-        conditionName += std::to_string(position->readableNum);
-        if (pos != followpos.back()) {
-          conditionName += ".";
-        }
-      } catch (...) {
-        log("Can't cast to PositionNode");
-      }
+    size_t column = 0;
+    while (column < columns && classesOf[firstOf[column]] != classesOf[c]) {
+      ++column;
     }
-    return conditionName;
+    if (column == columns) {
+      firstOf[columns++] = c;
+    }
+    columnOf[c] = column;
   }
+  return columns;
+}
 
-  std::string getFollowPosReadable() { return getPosReadable(followpos); }
-
-  char name;
-  std::string conditionName{};
-};
-
-struct EmptyNode : PositionNode {
-  EmptyNode() : PositionNode(SYMBOL_EMPTY, true) {}
+namespace {
 
-  virtual ~EmptyNode() {}
-};
+// Charges budget for the followpos sets of positionCount positions, which
+// are allocated next, and returns whether every limit still holds
+bool chargeFollowpos(size_t positionCount, CompileBudget *budget) {
+  size_t words = positionCount * ((positionCount + 63) / 64);
+  budget->charge(words * sizeof(uint64_t));
+  return budget->check(0);
+}
 
-struct Preprocessor {
+// Charges budget for the rest of the arena once it is parsed
+void chargeArena(const NodeArena &arena, CompileBudget *budget) {
+  budget->charge(arena.analysisBytes() - arena.words.size() * sizeof(uint64_t));
+  budget->check(0);
+}
 
-  std::string input;
-  using resultT = std::vector<Token>;
-  resultT result{};
+// Copies the limits of options into budget, whose clock is already running
+void limit(CompileBudget &budget, const CompileOptions &options) {
+  budget.maxStates = options.maxStates;
+  budget.maxBytes = options.maxBytes;
+  budget.maxMs = options.maxMs;
+}
 
-  Preprocessor(const std::string &input) : input(input) {}
+} // namespace
 
-  resultT preprocess() {
-    input += "#";
-    for (int i = 0; i < input.size(); ++i) {
-      // Stack concationation into one token
-      // TODO: Handle repeat
-      if (std::isalnum(input[i])) {
-        result.push_back(Token(TokenType::NODE, input[i]));
-        if (i + 1 < input.size() &&
-            (std::isalnum(input[i + 1]) || input[i + 1] == SYMBOL_LPAREN ||
-             input[i + 1] == SYMBOL_NUMBER_SIGN)) {
-          result.push_back(Token(TokenType::TOK_CONCAT, SYMBOL_CONCAT));
-        }
-      } else if (input[i] == '(') {
-        result.push_back(Token(TokenType::TOK_LPAREN, SYMBOL_LPAREN));
-      } else if (input[i] == ')') {
-        result.push_back(Token(TokenType::TOK_RPAREN, SYMBOL_RPAREN));
-        if (i + 1 < input.size() &&
-            (std::isalnum(input[i + 1]) || input[i + 1] == SYMBOL_LPAREN ||
-             input[i + 1] == SYMBOL_NUMBER_SIGN)) {
-          result.push_back(Token(TokenType::TOK_CONCAT, SYMBOL_CONCAT));
-        }
-      } else if (input[i] == '|') {
-        result.push_back(Token(TokenType::TOK_OR, SYMBOL_OR));
-      } else if (input[i] == '*') {
-        result.push_back(Token(TokenType::TOK_REPEAT, SYMBOL_REPEAT));
-        if (i + 1 < input.size() &&
-            (std::isalnum(input[i + 1]) || input[i + 1] == SYMBOL_LPAREN ||
-             input[i + 1] == SYMBOL_NUMBER_SIGN)) {
-          result.push_back(Token(TokenType::TOK_CONCAT, SYMBOL_CONCAT));
-        }
-      } else if (input[i] == '#') {
-        result.push_back(Token(TokenType::NODE, SYMBOL_NUMBER_SIGN));
-      }
-    }
-    return result;
+int32_t CompileContext::parse(const std::string &s, CompileBudget *budget) {
+  stats = CompileStats{};
+  if (budget != nullptr &&
+      !chargeFollowpos(Parser::positionCount(s), budget)) {
+    return NO_NODE;
   }
-};
-
-struct Parser {
 
-  std::vector<Token> input;
-  using iterType = std::vector<Token>::iterator;
-  std::shared_ptr<BaseNode> resultRoot = nullptr;
-  std::map<std::string, std::shared_ptr<BaseNode>> symbolsToNodes{};
-  iterType cursor;
-
-  Parser(std::vector<Token> tokens) : input(tokens), cursor(input.begin()) {}
-
-  std::shared_ptr<BaseNode> parseOr() {
-    auto res = parseConcat();
-    while (cursor != input.end() && cursor->type == TokenType::TOK_OR) {
-      ++cursor;
-      res = std::make_shared<OrNode>(res, parseConcat());
-    }
-    return res;
+  int32_t root = NO_NODE;
+  {
+    PhaseTimer timer(stats.parseMs);
+    root = Parser(s, arena).parse();
   }
-
-  std::shared_ptr<BaseNode> parseConcat() {
-    auto res = parseRepeat();
-    while (cursor != input.end() && cursor->type == TokenType::TOK_CONCAT) {
-      ++cursor;
-      res = std::make_shared<ConcatNode>(res, parseRepeat());
-    }
-    return res;
+  if (budget != nullptr) {
+    chargeArena(arena, budget);
   }
+  stats.positions = arena.positionCount();
+  stats.nodes = arena.nodes.size();
+  stats.shapes = arena.shapes.size();
 
-  std::shared_ptr<BaseNode> parseRepeat() {
-    auto res = parsePrimary();
-    while (cursor != input.end() && cursor->type == TokenType::TOK_REPEAT) {
-      ++cursor;
-      res = std::make_shared<RepeatNode>(res);
-    }
-    return res;
+  RE2DFA_TRACE("Expression parsed...");
+  return root;
+}
+
+int32_t
+CompileContext::parsePatterns(const std::vector<std::string> &patterns,
+                              CompileBudget *budget) {
+  stats = CompileStats{};
+  size_t positionCount = 0;
+  for (const std::string &pattern : patterns) {
+    positionCount += Parser::positionCount(pattern);
+  }
+  if (budget != nullptr && !chargeFollowpos(positionCount, budget)) {
+    return NO_NODE;
   }
 
-  std::shared_ptr<BaseNode> parsePrimary() {
-    if (cursor->type == TokenType::TOK_LPAREN) {
-      ++cursor;
-      std::shared_ptr<BaseNode> res = parseOr();
-      if (cursor != input.end() && cursor->type == TokenType::TOK_RPAREN) {
-        ++cursor;
-      }
-      return res;
+  int32_t root = NO_NODE;
+  {
+    PhaseTimer timer(stats.parseMs);
+    arena.reset(positionCount);
+    for (const std::string &pattern : patterns) {
+      int32_t next = Parser(pattern, arena, false).parse();
+      root = root == NO_NODE
+                 ? next
+                 : arena.add(NodeType::OR, SYMBOL_OR, root, next);
     }
-    if (cursor != input.end() && cursor->type == TokenType::NODE) {
-      auto res = std::make_shared<PositionNode>(cursor->value);
-      res->initializePositions();
-      ++cursor;
-      return res;
+    if (root == NO_NODE) {
+      root = arena.add(NodeType::EMPTY, SYMBOL_EMPTY);
     }
-    // There is no self positions for EmptyNode
-    return std::make_shared<EmptyNode>();
   }
-
-  std::shared_ptr<BaseNode> parse() {
-    resultRoot = parseOr();
-    return resultRoot;
+  if (budget != nullptr) {
+    chargeArena(arena, budget);
   }
-};
-
-std::shared_ptr<PositionNode>
-getNotMarked(const std::vector<std::shared_ptr<PositionNode>> &positions,
-             const std::vector<std::shared_ptr<PositionNode>> &marked) {
-  std::shared_ptr<PositionNode> result = nullptr;
-
-  std::for_each(positions.begin(), positions.end(),
-                [&result, &marked](std::shared_ptr<PositionNode> node) {
-                  if (std::find(marked.begin(), marked.end(), node) ==
-                      marked.end()) {
-                    result = node;
-                    return;
-                  }
-                });
-
-  return result;
-}
-
-DFA re2dfa(const std::string &s) {
+  stats.positions = arena.positionCount();
+  stats.nodes = arena.nodes.size();
+  stats.shapes = arena.shapes.size();
 
-  auto alpabet = Alphabet(s);
-
-  auto res = DFA(alpabet);
-
-  Preprocessor preprocessor(s);
-  auto tokens = preprocessor.preprocess();
+  RE2DFA_TRACE(patterns.size() << " patterns parsed...");
+  return root;
+}
 
-#ifdef DEBUG
-  std::for_each(tokens.begin(), tokens.end(),
-                [&res](Token t) { std::cout << t.value << " "; });
-  std::cout << std::endl;
-#endif
+PositionAutomaton CompileContext::positions(const std::string &s) {
+  return PositionAutomaton(arena, parse(s));
+}
 
-  Parser parser(tokens);
-  auto root = parser.parse();
+CompactDFA CompileContext::build(const std::string &s) {
+  return construct(parse(s));
+}
 
-  log("Expression parsed...");
+CompactDFA CompileContext::build(const std::string &s,
+                                 const CompileOptions &options) {
+  CompileBudget budget{};
+  limit(budget, options);
+  return buildParsed(parse(s, &budget), options, budget);
+}
 
-  auto R = std::make_shared<PositionNode>();
-  std::for_each(
-      root->firstpos.begin(), root->firstpos.end(),
-      [&R](std::shared_ptr<BaseNode> node) { R->followpos.push_back(node); });
+CompactDFA
+CompileContext::buildPatterns(const std::vector<std::string> &patterns,
+                              const CompileOptions &options) {
+  CompileBudget budget{};
+  limit(budget, options);
+  return buildParsed(parsePatterns(patterns, &budget), options, budget);
+}
 
+CompactDFA CompileContext::buildParsed(int32_t root,
+                                       const CompileOptions &options,
+                                       CompileBudget &budget) {
+  // Parsing may have passed a limit already
+  if (budget.status != CompileStatus::OK) {
+    stats.status = budget.status;
+    stats.peakBytes = budget.peakBytes;
+    return CompactDFA{};
+  }
 
-  std::vector<std::shared_ptr<PositionNode>> Q{};
-  Q.push_back(R);
-  res.create_state(R->getFollowPosReadable(), false);
-  res.set_initial(R->getFollowPosReadable());
-  std::vector<std::shared_ptr<PositionNode>> marked{};
+  CompactDFA res{};
+  if (options.threads > 1) {
+    PositionAutomaton automaton(arena, root);
+    budget.charge(automaton.bytes());
+    stats.columns = automaton.columns();
+    PhaseTimer timer(stats.subsetMs);
+    // Without limits the threads skip the shared atomic counters, so
+    // peakBytes covers only the arena and the automaton
+    res = buildParallel(automaton, options.threads, &stats, options.named,
+                        budget.limited() ? &budget : nullptr);
+  } else {
+    res = construct(root, options.named, &budget);
+  }
+  stats.status = budget.status;
+  stats.peakBytes = budget.peakBytes;
+  if (stats.status != CompileStatus::OK) {
+    // Nothing of a construction that was cut short is kept
+    return CompactDFA(res.alphabet, res.columnOf, res.columns());
+  }
+  if (options.minimize) {
+    PhaseTimer timer(stats.minimizeMs);
+    res = minimize(res);
+    stats.minimizedStates = res.stateCount;
+  }
+  return res;
+}
 
-  int cycle = 1;
+CompileResult CompileContext::tryBuild(const std::string &s,
+                                       const CompileOptions &options) {
+  CompileResult res{};
+  CompileBudget budget{};
+  limit(budget, options);
+  int32_t root = parse(s, &budget);
+  res.dfa = buildParsed(root, options, budget);
+  res.status = stats.status;
+  if (res.status != CompileStatus::OK && options.fallback) {
+    size_t positionCount = Parser::positionCount(s);
+    res.fallbackBytes =
+        BitParallelMatcher::tableBytes((positionCount + 63) / 64);
+    if (options.maxBytes == 0 || res.fallbackBytes <= options.maxBytes) {
+      // A limit may have stopped parsing before it started
+      if (root == NO_NODE) {
+        CompileStats kept = stats;
+        root = parse(s);
+        stats = kept;
+      }
+      res.fallback =
+          std::make_unique<BitParallelMatcher>(PositionAutomaton(arena, root));
+    }
+  }
+  return res;
+}
 
-  while (R != nullptr) {
+DFA CompileContext::compile(const std::string &s,
+                            const CompileOptions &options) {
+  CompactDFA dfa = build(s, options);
+  if (stats.status != CompileStatus::OK) {
+    throw CompileError(stats.status);
+  }
+  PhaseTimer timer(stats.toDFAMs);
+  return dfa.toDFA();
+}
 
-    log("\nCycle " + std::to_string(cycle) +
-        ". R: " + R->getFollowPosReadable());
+CompactDFA CompileContext::construct(int32_t root, bool named,
+                                     CompileBudget *budget) {
+  PhaseTimer timer(stats.subsetMs);
+  stats.lookups = 0;
+  stats.duplicateHits = 0;
+  stats.transitions = 0;
+  stats.totalSetSize = 0;
+  stats.maxSetSize = 0;
+
+  std::string alpabet = arena.alphabet();
+  const std::vector<int32_t> &endPositions =
+      arena.symbolToPositions[SYMBOL_NUMBER_SIGN];
+
+  // Transitions are built per symbol class; the smallest symbol of each
+  // class stands for the whole class
+  std::array<uint8_t, 256> columnOf{};
+  size_t columns = arena.symbolClasses(columnOf);
+  std::array<char, 256> representatives{};
+  for (char c : alpabet) {
+    char &representative =
+        representatives[columnOf[static_cast<unsigned char>(c)]];
+    if (representative == '\0') {
+      representative = c;
+    }
+  }
+  stats.columns = columns;
+
+  CompactDFA res(alpabet, columnOf, columns);
+  res.setPatternCount(endPositions.size());
+
+  // The set of state i is at i * wordsPerSet in stateSets, and stateTable
+  // maps sets back to ids. States are expanded in id order, so the ones
+  // from r on are unmarked. The scratch keeps its capacity from one
+  // construction to the next; the part in use is charged to budget, and so
+  // is the table of res as it grows.
+  size_t wordsPerSet = arena.wordsPerSet;
+  stateSets.clear();
+  stateTable.assign(64, DEAD_STATE);
+  scratchSets.assign(2 * wordsPerSet, 0);
+  uint64_t *R = scratchSets.data();
+  uint64_t *S = R + wordsPerSet;
+  size_t chargedBytes = 0;
+  auto charge = [this, &res, &chargedBytes, budget]() {
+    size_t bytes = res.transitions.capacity() * sizeof(uint32_t) +
+                   res.accept.capacity() * sizeof(uint64_t) +
+                   (stateSets.size() + scratchSets.size()) * sizeof(uint64_t) +
+                   stateTable.size() * sizeof(uint32_t);
+    if (budget != nullptr && bytes != chargedBytes) {
+      budget->charge(bytes - chargedBytes);
+    }
+    chargedBytes = bytes;
+  };
+
+  const Shape &rootShape = arena.shapes[arena.nodes[root].shape];
+  PositionSet::uniteShifted(S, arena.shapeFirstpos(rootShape),
+                            rootShape.setWords, arena.nodes[root].base);
+  stateTable[stateSlot(S)] = 0;
+  stateSets.insert(stateSets.end(), S, S + wordsPerSet);
+  res.addState();
+  charge();
+  stats.addSet(PositionSet::count(S, wordsPerSet));
+
+  for (uint32_t r = 0; r < res.stateCount; ++r) {
+    if (budget != nullptr && !budget->check(res.stateCount)) {
+      stats.states = res.stateCount;
+      return res;
+    }
+    std::copy_n(&stateSets[r * wordsPerSet], wordsPerSet, R);
 
-    marked.push_back(R);
+    RE2DFA_TRACE("\nCycle " << r + 1
+                            << ". R: " << getPosReadable(R, wordsPerSet));
 
-    std::for_each(alpabet.begin(), alpabet.end(), [&R, &Q, &res](char c) {
-      PositionNode S{};
+    for (size_t column = 0; column < res.columns(); ++column) {
+      char c = representatives[column];
+      std::fill(S, S + wordsPerSet, 0);
 
-      std::for_each(symbolToPositions[c].begin(), symbolToPositions[c].end(),
-                    [&R, &S](std::shared_ptr<PositionNode> node) {
-                      log(std::string(1, node->name) + " " +
-                          node->getFollowPosReadable());
-                      if (std::find(R->followpos.begin(), R->followpos.end(),
-                                    node) != R->followpos.end()) {
-                        for (auto it = node->followpos.begin();
-                             it != node->followpos.end(); ++it) {
-                          S.followpos.push_back(*it);
-                        }
-                      }
-                    });
+      const auto &positions =
+          arena.symbolToPositions[static_cast<unsigned char>(c)];
+      for (int32_t pos : positions) {
+        RE2DFA_TRACE(c << " " << pos + 1);
+        if (PositionSet::contains(R, pos)) {
+          PositionSet::unite(S, arena.followpos(pos), wordsPerSet);
+        }
+      }
 
-      std::string log_str{};
-      log_str += "Symbol " + std::string(1, c) +
-                 ". S: " + S.getFollowPosReadable() + ". Q:";
-      std::for_each(Q.begin(), Q.end(),
-                    [&log_str](std::shared_ptr<PositionNode> node) {
-                      log_str += " " + node->getFollowPosReadable();
-                    });
-      log(log_str);
+      RE2DFA_TRACE("Symbol " << c << ". S: " << getPosReadable(S, wordsPerSet)
+                             << ". |Q|: " << res.stateCount);
 
-      if (S.followpos.size() == 0) {
-        return;
+      if (PositionSet::empty(S, wordsPerSet)) {
+        continue;
       }
 
       // S not in Q
-      bool SinQ = false;
-      for (auto qIt = Q.begin(); qIt != Q.end(); ++qIt) {
-        if ((*qIt)->followpos.size() != S.followpos.size()) {
-          continue;
-        }
-
-        int foundCnt = 0;
-        for (auto qFollowposIt = (*qIt)->followpos.begin();
-             qFollowposIt != (*qIt)->followpos.end(); ++qFollowposIt) {
-          for (auto sFollowposIt = S.followpos.begin();
-               sFollowposIt != S.followpos.end(); ++sFollowposIt) {
-            if ((*qFollowposIt) == (*sFollowposIt)) {
-              ++foundCnt;
-              break;
-            }
-          }
-        }
-        if ((*qIt)->followpos.size() == foundCnt) {
-          SinQ = true;
-          break;
+      ++stats.lookups;
+      size_t slot = stateSlot(S);
+      uint32_t to = stateTable[slot];
+      if (to == DEAD_STATE) {
+        to = res.addState();
+        stateTable[slot] = to;
+        stateSets.insert(stateSets.end(), S, S + wordsPerSet);
+        if (2 * res.stateCount > stateTable.size()) {
+          growStateTable(res.stateCount);
         }
-      }
-
-      if (!SinQ) {
-        Q.push_back(std::make_shared<PositionNode>(S));
-        res.create_state(S.getFollowPosReadable(), false);
-        log("New state: " + S.getFollowPosReadable());
+        charge();
+        stats.addSet(PositionSet::count(S, wordsPerSet));
+        RE2DFA_TRACE("New state: " << getPosReadable(S, wordsPerSet));
       } else {
-        log("State already in Q: " + S.getFollowPosReadable());
+        ++stats.duplicateHits;
+        RE2DFA_TRACE("State already in Q: " << getPosReadable(S, wordsPerSet));
       }
 
-      res.set_trans(R->getFollowPosReadable(), c, S.getFollowPosReadable());
-      log("Set trans: " + R->getFollowPosReadable() + " ]--" + c + "--> " +
-          S.getFollowPosReadable());
-    });
-
-    R = getNotMarked(Q, marked);
-
-    ++cycle;
+      res.setTransition(r, column, to);
+      ++stats.transitions;
+      RE2DFA_TRACE("Set trans: " << getPosReadable(R, wordsPerSet) << " ]--"
+                                 << c << "--> "
+                                 << getPosReadable(S, wordsPerSet));
+    }
   }
 
-  std::for_each(Q.begin(), Q.end(), [&res](std::shared_ptr<PositionNode> node) {
-    for (auto it = node->followpos.begin(); it != node->followpos.end(); ++it) {
-      auto position = dynamic_cast<PositionNode *>(it->get());
-      if (position->name == SYMBOL_NUMBER_SIGN) {
-        res.make_final(node->getFollowPosReadable());
-        log("Set final: " + node->getFollowPosReadable());
-        break;
+  // Every pattern ends with its own end marker. Position-set names, if
+  // wanted, are computed once here.
+  for (uint32_t state = 0; state < res.stateCount; ++state) {
+    const uint64_t *set = &stateSets[state * wordsPerSet];
+    res.markAccepting(state, set, endPositions);
+    if (res.isFinal(state)) {
+      RE2DFA_TRACE("Set final: " << getPosReadable(set, wordsPerSet));
+    }
+  }
+  stats.states = res.stateCount;
+  if (named) {
+    res.names.reserve(res.stateCount);
+    if (budget != nullptr) {
+      budget->charge(res.names.capacity() * sizeof(std::string));
+    }
+    for (uint32_t state = 0; state < res.stateCount; ++state) {
+      res.names.push_back(
+          getPosReadable(&stateSets[state * wordsPerSet], wordsPerSet));
+      if (budget != nullptr) {
+        budget->charge(res.names.back().capacity());
+        if (!budget->check(res.stateCount)) {
+          return res;
+        }
       }
     }
-  });
+  }
 
   return res;
 }
+
+size_t CompileContext::stateSlot(const uint64_t *set) const {
+  size_t wordsPerSet = arena.wordsPerSet;
+  uint64_t key = PositionSet::hash(set, wordsPerSet) * 0x9E3779B97F4A7C15ull;
+  for (size_t slot = key ^ key >> 32;; ++slot) {
+    slot &= stateTable.size() - 1;
+    uint32_t id = stateTable[slot];
+    if (id == DEAD_STATE ||
+        std::memcmp(&stateSets[id * wordsPerSet], set,
+                    wordsPerSet * sizeof(uint64_t)) == 0) {
+      return slot;
+    }
+  }
+}
+
+void CompileContext::growStateTable(size_t states) {
+  stateTable.assign(2 * stateTable.size(), DEAD_STATE);
+  for (uint32_t id = 0; id < states; ++id) {
+    stateTable[stateSlot(&stateSets[id * arena.wordsPerSet])] = id;
+  }
+}
+
+CompileContext &threadContext() {
+  thread_local CompileContext context{};
+  return context;
+}
+
+DFA re2dfa(const std::string &s, const CompileOptions &options) {
+  return threadContext().compile(s, options);
+}
+
+DFA re2dfa(const std::string &s) { return re2dfa(s, CompileOptions{}); }
+
+const CompileStats &re2dfaStats() { return threadContext().stats; }
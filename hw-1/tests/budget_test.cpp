@@ -0,0 +1,83 @@
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include "re2dfa.hpp"
+
+// Passes limits to the compile API and checks that no automaton cut short
+// is handed back as a DFA, that the fallback matches what the full
+// automaton matches, and that a fallback too large for maxBytes is withheld.
+
+int main() {
+  const std::string pattern = "(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)";
+  CompileContext context{};
+  int failures = 0;
+
+  CompileOptions limited{};
+  limited.maxStates = 2;
+  try {
+    context.compile(pattern, limited);
+    std::cerr << "a DFA is returned past the state limit" << std::endl;
+    ++failures;
+  } catch (const CompileError &error) {
+    if (error.status != CompileStatus::STATE_LIMIT) {
+      std::cerr << "unexpected status " << statusName(error.status)
+                << std::endl;
+      ++failures;
+    }
+  }
+
+  Matcher full(context.build(pattern));
+  limited.fallback = true;
+  CompileResult result = context.tryBuild(pattern, limited);
+  if (result.ok() || result.fallback == nullptr) {
+    std::cerr << "no fallback past the state limit" << std::endl;
+    ++failures;
+  } else {
+    std::mt19937 random(99);
+    for (int i = 0; i < 2000; ++i) {
+      std::string word(random() % 12, 'a');
+      for (char &c : word) {
+        c = "abc"[random() % 3];
+      }
+      if (result.fallback->match(word) != full.match(word)) {
+        std::cerr << word << ": the fallback disagrees with the DFA"
+                  << std::endl;
+        ++failures;
+      }
+    }
+  }
+
+  CompileOptions tight{};
+  tight.maxBytes = 1000;
+  tight.fallback = true;
+  result = context.tryBuild(pattern, tight);
+  if (result.ok() || result.fallback != nullptr ||
+      result.fallbackBytes <= tight.maxBytes) {
+    std::cerr << "a fallback of " << result.fallbackBytes
+              << " bytes is built under a limit of " << tight.maxBytes
+              << std::endl;
+    ++failures;
+  }
+
+  // The followpos sets of a long pattern pass maxBytes before parsing
+  CompileOptions small{};
+  small.maxBytes = 1 << 20;
+  result = context.tryBuild(std::string(4000, 'a'), small);
+  if (result.status != CompileStatus::MEMORY_LIMIT ||
+      context.stats.positions != 0 ||
+      context.stats.peakBytes <= small.maxBytes) {
+    std::cerr << "a pattern of 4000 positions is parsed under a limit of "
+              << small.maxBytes << " bytes" << std::endl;
+    ++failures;
+  }
+
+  try {
+    Matcher empty(result.dfa);
+    std::cerr << "a Matcher is built from a DFA without states" << std::endl;
+    ++failures;
+  } catch (const std::invalid_argument &) {
+  }
+  return failures == 0 ? 0 : 1;
+}
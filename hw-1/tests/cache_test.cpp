@@ -0,0 +1,100 @@
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "re2dfa.hpp"
+#include "random_regex.hpp"
+
+// Stores automata in a CompileCache and checks that what is loaded back
+// prints exactly like the automaton that was stored, names included, and
+// that damaged files are rejected or at least safe to match on.
+
+int main() {
+  std::filesystem::path directory =
+      std::filesystem::temp_directory_path() /
+      ("re2dfa_cache_test." + std::to_string(std::random_device()()));
+  CompileCache cache{directory.string()};
+  std::vector<std::string> regexes = randomRegexes(7, 200, 5, "abc");
+  CompileContext context{};
+  int failures = 0;
+
+  for (size_t i = 0; i < regexes.size(); ++i) {
+    const std::string &regex = regexes[i];
+    CompileOptions options{};
+    options.minimize = i % 2 == 1;
+    options.named = i % 4 < 2;
+    CompactDFA dfa = context.build(regex, options);
+    std::string expected{};
+    dfa.write(expected);
+
+    std::string key =
+        CompileCache::keyFor(regex, options.minimize, options.named);
+    MappedDFA loaded{};
+    std::string text{};
+    if (!cache.store(key, Matcher(dfa), dfa.names) ||
+        !cache.load(key, loaded)) {
+      std::cerr << regex << ": can't store or load " << cache.pathFor(key)
+                << std::endl;
+      ++failures;
+    } else {
+      loaded.toCompactDFA().write(text);
+      if (text != expected) {
+        std::cerr << regex << ": the cached automaton prints differently"
+                  << std::endl;
+        ++failures;
+      }
+    }
+    if (key == CompileCache::keyFor(regex, options.minimize,
+                                    !options.named)) {
+      std::cerr << regex << ": named and numeric entries share a key"
+                << std::endl;
+      ++failures;
+    }
+  }
+
+  // Every single flipped bit either gets the file rejected or leaves a
+  // table that matching stays inside of, which the sanitizers check
+  std::string key = CompileCache::keyFor("(a|b)*abb", false, true);
+  CompactDFA dfa = context.build("(a|b)*abb");
+  std::string bytes = serializeDFA(Matcher(dfa), key, dfa.names);
+  std::string path = (directory / "damaged.r2dfa").string();
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    std::string damaged = bytes;
+    damaged[i] ^= 0x80;
+    std::ofstream(path, std::ios::binary).write(damaged.data(),
+                                                damaged.size());
+    MappedDFA mapped{};
+    if (mapped.open(path, key)) {
+      mapped.matcher.match("abababbbab");
+      mapped.toCompactDFA();
+    }
+  }
+  std::ofstream(path, std::ios::binary).write(bytes.data(), bytes.size() - 3);
+  MappedDFA truncated{};
+  if (truncated.open(path, key)) {
+    std::cerr << "a truncated file is accepted" << std::endl;
+    ++failures;
+  }
+
+  // A table whose size in bytes wraps around
+  DFAFileHeader header{};
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  header.rows = header.columns = UINT32_MAX;
+  std::string huge = bytes;
+  std::memcpy(&huge[0], &header, sizeof(header));
+  std::ofstream(path, std::ios::binary).write(huge.data(), huge.size());
+  MappedDFA wrapped{};
+  if (wrapped.open(path, key)) {
+    std::cerr << "a table of " << UINT32_MAX << " by " << UINT32_MAX
+              << " cells is accepted" << std::endl;
+    ++failures;
+  }
+
+  std::filesystem::remove_all(directory);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+
+#include "re2dfa.hpp"
+
+// Checks that the numeric parsers accept plain numbers only and that the
+// tool named on the command line prints usage on every malformed number
+// instead of wrapping it, ignoring it or aborting.
+
+// Exit status of command, and whether it printed usage
+int run(const std::string &command, bool &usage) {
+  const std::string output = "cli_test.out";
+  int status = std::system((command + " > " + output + " 2>&1").c_str());
+  std::ifstream in(output);
+  std::string text((std::istreambuf_iterator<char>(in)),
+                   std::istreambuf_iterator<char>());
+  std::remove(output.c_str());
+  usage = text.find("Usage: ") != std::string::npos;
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int main(int argc, char **argv) {
+  int failures = 0;
+
+  size_t count = 0;
+  double milliseconds = 0;
+  for (const char *text : {"0", "7", "1024"}) {
+    if (!parseCount(text, MAX_THREADS, count)) {
+      std::cerr << "count " << text << " is rejected" << std::endl;
+      ++failures;
+    }
+  }
+  for (const char *text : {"", "-1", "+1", " 1", "1 ", "2x", "1025",
+                           "99999999999999999999999"}) {
+    if (parseCount(text, MAX_THREADS, count)) {
+      std::cerr << "count '" << text << "' is accepted" << std::endl;
+      ++failures;
+    }
+  }
+  for (const char *text : {"0", "2.5", ".5", "100"}) {
+    if (!parseMilliseconds(text, milliseconds)) {
+      std::cerr << "milliseconds " << text << " are rejected" << std::endl;
+      ++failures;
+    }
+  }
+  for (const char *text : {"", "-1", "-0", "nan", "inf", "1e999", "5ms"}) {
+    if (parseMilliseconds(text, milliseconds)) {
+      std::cerr << "milliseconds '" << text << "' are accepted" << std::endl;
+      ++failures;
+    }
+  }
+
+  // Then a tool, the status it exits with on usage errors, its numeric
+  // options and, after "--", the arguments that follow them. Each option is
+  // passed every malformed value, and a valid one if arguments follow.
+  if (argc > 3) {
+    int expected = std::atoi(argv[2]);
+    std::string rest{};
+    int end = 3;
+    for (; end < argc && std::string(argv[end]) != "--"; ++end) {
+    }
+    for (int i = end + 1; i < argc; ++i) {
+      rest += std::string(" ") + argv[i];
+    }
+    for (int i = 3; i < end; ++i) {
+      std::string option = argv[i];
+      std::vector<std::string> values = {"-1", "-0", "2x", "x", "",
+                                         "99999999999999999999999"};
+      if (option == "--threads" || option == "--jobs" || option == "-j") {
+        values.push_back("5000");
+      }
+      for (const std::string &value : values) {
+        std::string command =
+            std::string(argv[1]) + " " + option + " '" + value + "'" + rest;
+        bool usage = false;
+        int status = run(command, usage);
+        if (status != expected || !usage) {
+          std::cerr << command << " exits with " << status << std::endl;
+          ++failures;
+        }
+      }
+      if (!rest.empty()) {
+        bool usage = false;
+        run(std::string(argv[1]) + " " + option + " 3" + rest, usage);
+        if (usage) {
+          std::cerr << option << " 3 is rejected" << std::endl;
+          ++failures;
+        }
+      }
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
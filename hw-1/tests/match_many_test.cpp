@@ -0,0 +1,52 @@
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "re2dfa.hpp"
+#include "random_regex.hpp"
+
+// Matches batches of inputs of mixed lengths, empty and long ones included,
+// with matchMany and checks every result against match.
+
+int main() {
+  std::vector<std::string> regexes = randomRegexes(4242, 200, 5, "abc");
+  std::mt19937 random(4242);
+  CompileContext context{};
+  int failures = 0;
+  for (size_t i = 0; i < regexes.size(); ++i) {
+    const std::string &regex = regexes[i];
+    Matcher matcher(minimize(context.build(regex)));
+
+    // Counts below, at and well above the number of lanes and the block
+    // that inputs are ordered in
+    size_t count = std::vector<size_t>{0, 3, 8, 9, 100, 700}[i % 6];
+    std::vector<std::string> strings(count);
+    for (std::string &s : strings) {
+      size_t length = random() % 4 == 0 ? random() % 300 : random() % 12;
+      for (size_t j = 0; j < length; ++j) {
+        s += "abcd"[random() % (random() % 16 == 0 ? 4 : 3)];
+      }
+    }
+    std::vector<std::string_view> inputs(strings.begin(), strings.end());
+
+    std::vector<uint64_t> bits{};
+    matcher.matchMany(inputs.data(), inputs.size(), bits);
+    if (bits.size() != (count + 63) / 64) {
+      std::cerr << regex << ": " << bits.size() << " words for " << count
+                << " inputs" << std::endl;
+      ++failures;
+      continue;
+    }
+    for (size_t j = 0; j < count; ++j) {
+      bool many = bits[j / 64] >> (j % 64) & 1;
+      if (many != matcher.match(inputs[j])) {
+        std::cerr << regex << ": input " << j << " '" << inputs[j]
+                  << "' matched " << many << std::endl;
+        ++failures;
+      }
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "re2dfa.hpp"
+#include "random_regex.hpp"
+
+// Minimizes the automata of random expressions and checks that each result
+// accepts the same words as the automaton it came from and that no two of
+// its states can be merged any further.
+
+bool accepts(const CompactDFA &dfa, const std::string &word) {
+  uint32_t state = 0;
+  for (char c : word) {
+    if (dfa.columnOf[static_cast<unsigned char>(c)] == NO_COLUMN) {
+      return false;
+    }
+    state = dfa.nextBySymbol(state, c);
+    if (state == DEAD_STATE) {
+      return false;
+    }
+  }
+  return dfa.isFinal(state);
+}
+
+// Class of every state, the dead state last, after naive Moore refinement.
+// States in the same class are told apart by no word.
+std::vector<size_t> equivalenceClasses(const CompactDFA &dfa) {
+  const uint32_t dead = dfa.stateCount;
+  std::vector<size_t> classes(dfa.stateCount + 1, 0);
+  for (uint32_t state = 0; state < dead; ++state) {
+    classes[state] = dfa.isFinal(state);
+  }
+  size_t count = 0;
+  while (true) {
+    std::map<std::vector<size_t>, size_t> ids{};
+    std::vector<size_t> refined(classes.size());
+    for (uint32_t state = 0; state <= dead; ++state) {
+      std::vector<size_t> key{classes[state]};
+      for (size_t column = 0; column < dfa.columns(); ++column) {
+        uint32_t to = state == dead ? DEAD_STATE : dfa.next(state, column);
+        key.push_back(classes[to == DEAD_STATE ? dead : to]);
+      }
+      refined[state] = ids.emplace(key, ids.size()).first->second;
+    }
+    classes = refined;
+    if (ids.size() == count) {
+      return classes;
+    }
+    count = ids.size();
+  }
+}
+
+int main() {
+  // Every word of up to six symbols
+  const std::vector<std::string> words = allWords("abc", 6);
+  CompileContext context{};
+  int failures = 0;
+  for (const std::string &regex : randomRegexes(12345, 500, 5, "abc")) {
+    CompactDFA dfa = context.build(regex);
+    CompactDFA minimal = minimize(dfa);
+
+    bool same = true;
+    for (const std::string &word : words) {
+      same = same && accepts(dfa, word) == accepts(minimal, word);
+    }
+
+    // Minimal means no two states are equivalent
+    std::vector<size_t> classes = equivalenceClasses(minimal);
+    size_t distinct =
+        std::set<size_t>(classes.begin(), classes.end() - 1).size();
+    bool reduced = distinct == minimal.stateCount;
+    if (!same || !reduced || minimal.stateCount > dfa.stateCount) {
+      std::cerr << regex << ": " << dfa.stateCount << " states minimized to "
+                << minimal.stateCount << " of " << distinct
+                << " classes, same language " << same << std::endl;
+      ++failures;
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
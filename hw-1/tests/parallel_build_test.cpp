@@ -0,0 +1,51 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "re2dfa.hpp"
+#include "random_regex.hpp"
+
+// Builds automata on several threads and checks that they are identical to
+// the single-threaded ones, names and state order included, and that a
+// limit stops every thread.
+
+int main() {
+  std::vector<std::string> patterns = {
+      "(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)",
+      "(a|b|c)d(a|b|c)d(a|b|c)d(a|b|c)d",
+      "c(a|b)*|d(a|b)*|e(a|b)*|f(a|b)*",
+  };
+  for (const std::string &regex : randomRegexes(2024, 200, 6, "abcd")) {
+    patterns.push_back(regex);
+  }
+
+  CompileContext context{};
+  int failures = 0;
+  for (const std::string &pattern : patterns) {
+    std::string expected{};
+    context.build(pattern, CompileOptions{}).write(expected);
+    for (size_t threads : {2, 3, 8}) {
+      CompileOptions options{};
+      options.threads = threads;
+      std::string text{};
+      context.build(pattern, options).write(text);
+      if (text != expected) {
+        std::cerr << pattern << ": " << threads
+                  << " threads build a different automaton" << std::endl;
+        ++failures;
+      }
+    }
+  }
+
+  CompileOptions limited{};
+  limited.threads = 4;
+  limited.maxStates = 100;
+  CompactDFA dfa = context.build(patterns[0], limited);
+  if (context.stats.status != CompileStatus::STATE_LIMIT ||
+      dfa.stateCount != 0) {
+    std::cerr << "a state limit does not stop the threads: "
+              << statusName(context.stats.status) << std::endl;
+    ++failures;
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "re2dfa.hpp"
+
+// Compiles the same expressions from many threads at once, each in its own
+// order, and checks every automaton against the one compiled serially.
+
+const std::vector<std::string> PATTERNS = {
+    "a",
+    "(a|b)*abb",
+    "((a|b)*c|c)*a|b",
+    "(a|b)*a(a|b)(a|b)(a|b)",
+    "(a|aa)*(a|aa)*(a|aa)*",
+    "(a|b|c)d(a|b|c)d(a|b|c)d",
+    "c(a|b)*|d(a|b)*|e(a|b)*",
+    "((a|b)(c|d))*|(ab|cd)*e",
+    "(0|1|2|3|4|5|6|7|8|9)(0|1|2|3|4|5|6|7|8|9)*x(a|b|c)*",
+    "a|(|b)*|c*d",
+};
+
+constexpr size_t THREADS = 8;
+constexpr size_t ROUNDS = 200;
+
+int main() {
+  std::vector<std::string> expected{};
+  std::vector<std::string> expectedMinimal{};
+  CompileOptions minimal{};
+  minimal.minimize = true;
+  for (const std::string &pattern : PATTERNS) {
+    expected.push_back(re2dfa(pattern).to_string());
+    expectedMinimal.push_back(re2dfa(pattern, minimal).to_string());
+  }
+
+  std::vector<size_t> failures(THREADS, 0);
+  std::vector<std::thread> threads{};
+  for (size_t t = 0; t < THREADS; ++t) {
+    threads.emplace_back([t, &expected, &expectedMinimal, &minimal,
+                          &failures]() {
+      // Half of the threads share the thread-local context of re2dfa, the
+      // other half keep a context of their own warm across rounds
+      CompileContext context{};
+      for (size_t round = 0; round < ROUNDS; ++round) {
+        for (size_t i = 0; i < PATTERNS.size(); ++i) {
+          size_t p = (i + t + round) % PATTERNS.size();
+          bool minimize = (round + i) % 2 == 1;
+          CompileOptions options = minimize ? minimal : CompileOptions{};
+          std::string text = t % 2 == 0
+                                 ? re2dfa(PATTERNS[p], options).to_string()
+                                 : context.compile(PATTERNS[p], options)
+                                       .to_string();
+          if (text != (minimize ? expectedMinimal : expected)[p]) {
+            ++failures[t];
+          }
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  size_t total = 0;
+  for (size_t t = 0; t < THREADS; ++t) {
+    if (failures[t] != 0) {
+      std::cerr << "thread " << t << ": " << failures[t]
+                << " automata differ from the serial ones" << std::endl;
+    }
+    total += failures[t];
+  }
+  return total == 0 ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "re2dfa.hpp"
+#include "random_regex.hpp"
+
+// Searches the products of random expressions for words, with roomy and
+// with tiny lazy caches, and checks each answer against full automata: a
+// witness must be in the language and as short as any word found by brute
+// force, and no witness means brute force finds none either.
+
+int main() {
+  // Every word of up to six symbols, shortest first
+  const std::vector<std::string> words = allWords("abcd", 6);
+
+  std::vector<std::string> regexes = randomRegexes(31337, 600, 4, "abc");
+  CompileContext context{};
+  int failures = 0;
+  for (int i = 0; i < 300; ++i) {
+    const std::string &first = regexes[2 * i];
+    const std::string &second = i % 5 == 0 ? first : regexes[2 * i + 1];
+    Matcher a(context.build(first));
+    Matcher b(context.build(second));
+    size_t budget = i % 3 == 0 ? 200 : 8 << 20;
+
+    // Operations in ProductOperation order, then the language of a alone
+    for (int operation = 0; operation < 4; ++operation) {
+      auto contains = [&](const std::string &word) {
+        bool inA = a.match(word);
+        bool inB = b.match(word);
+        switch (operation) {
+        case 0:
+          return inA && inB;
+        case 1:
+          return inA && !inB;
+        case 2:
+          return inA != inB;
+        default:
+          return inA;
+        }
+      };
+      LazyDFA lazyA(context.positions(first), budget);
+      LazyDFA lazyB(context.positions(second), budget);
+      WordSearch search =
+          operation == 3
+              ? findWord(lazyA)
+              : findWord(lazyA, lazyB,
+                         static_cast<ProductOperation>(operation));
+      if (search.status != CompileStatus::OK) {
+        continue;
+      }
+
+      std::string shortest{};
+      bool exists = false;
+      for (size_t w = 0; w < words.size() && !exists; ++w) {
+        exists = contains(words[w]);
+        shortest = words[w];
+      }
+      bool right = search.found
+                       ? contains(search.witness) &&
+                             (!exists || search.witness.size() ==
+                                             shortest.size())
+                       : !exists;
+      if (!right) {
+        std::cerr << first << " / " << second << ": operation " << operation
+                  << " found " << search.found << " '" << search.witness
+                  << "', brute force '" << (exists ? shortest : "-") << "'"
+                  << std::endl;
+        ++failures;
+      }
+    }
+
+    // Matching through a cache that is flushed over and over
+    LazyDFA lazy(context.positions(first), 200);
+    for (size_t w = 0; w < words.size(); w += 7) {
+      if (lazy.match(words[w]) != a.match(words[w])) {
+        std::cerr << first << ": lazy and full matching disagree on '"
+                  << words[w] << "'" << std::endl;
+        ++failures;
+      }
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// Random expressions over a given alphabet for the property tests, and the
+// words to check them on.
+
+// Expression of concatenations, alternatives, stars and optional parts,
+// nested up to depth deep, with symbols from symbols
+inline std::string randomRegex(std::mt19937 &random, int depth,
+                               const std::string &symbols) {
+  switch (depth > 0 ? random() % 6 : random() % 2) {
+  case 0:
+  case 1:
+    return std::string(1, symbols[random() % symbols.size()]);
+  case 2:
+    return randomRegex(random, depth - 1, symbols) +
+           randomRegex(random, depth - 1, symbols);
+  case 3:
+    return "(" + randomRegex(random, depth - 1, symbols) + "|" +
+           randomRegex(random, depth - 1, symbols) + ")";
+  case 4:
+    return "(" + randomRegex(random, depth - 1, symbols) + ")*";
+  default:
+    return "(|" + randomRegex(random, depth - 1, symbols) + ")";
+  }
+}
+
+// count expressions of randomRegex, the same for the same seed
+inline std::vector<std::string> randomRegexes(uint32_t seed, size_t count,
+                                              int depth,
+                                              const std::string &symbols) {
+  std::mt19937 random(seed);
+  std::vector<std::string> res{};
+  res.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    res.push_back(randomRegex(random, depth, symbols));
+  }
+  return res;
+}
+
+// Every word over symbols of up to maxLength symbols, shortest first
+inline std::vector<std::string> allWords(const std::string &symbols,
+                                         size_t maxLength) {
+  std::vector<std::string> res{""};
+  for (size_t from = 0; res[from].size() < maxLength; ++from) {
+    for (char c : symbols) {
+      res.push_back(res[from] + c);
+    }
+  }
+  return res;
+}
@@ -0,0 +1,63 @@
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include "re2dfa.hpp"
+
+// Checks that a warm CompileContext parses and runs subset construction
+// without touching the heap, apart from the automaton it hands back.
+
+size_t allocations = 0;
+
+void *operator new(size_t size) {
+  ++allocations;
+  if (void *p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+// Allocations made by f once it has been run a few times
+template <typename F> size_t warmAllocations(F f) {
+  for (int i = 0; i < 3; ++i) {
+    f();
+  }
+  size_t before = allocations;
+  f();
+  return allocations - before;
+}
+
+int main() {
+  const std::string pattern = "((a|b)*c|(0|1|2)d*)*(a|b)(a|b)e|f(g|h)*";
+  CompileContext context{};
+  int failures = 0;
+
+  size_t parse = warmAllocations([&]() { context.parse(pattern); });
+  if (parse != 0) {
+    std::cerr << "warm parse allocates " << parse << " times" << std::endl;
+    ++failures;
+  }
+
+  // Scratch is reused, so the only allocations left are those of the
+  // tables of the automaton handed back
+  CompactDFA dfa{};
+  size_t build = warmAllocations(
+      [&]() { dfa = context.construct(context.parse(pattern), false); });
+  size_t result = warmAllocations([&]() {
+    CompactDFA tables(dfa.alphabet, dfa.columnOf, dfa.columns());
+    for (size_t state = 0; state < dfa.stateCount; ++state) {
+      tables.addState();
+    }
+  });
+  if (build != result) {
+    std::cerr << "warm construction allocates " << build
+              << " times, its result " << result << " times" << std::endl;
+    ++failures;
+  }
+  return failures == 0 ? 0 : 1;
+}